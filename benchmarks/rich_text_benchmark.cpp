@@ -0,0 +1,222 @@
+#include "../sources/rich_text.hpp"
+#include <SFML/Graphics/RenderTexture.hpp>
+#include <SFML/Graphics/Image.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Usage: rich_text_benchmark <output.json> <font> [fallback fonts...]
+// Fonts are used in fallback order: list a latin/cyrillic font first, then CJK and emoji ones
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	struct Corpus {
+		const char *Name;
+		const char *Utf8;
+	};
+
+	const Corpus Corpora[] = {
+		{"ascii",    "The quick brown fox jumps over the lazy dog. 0123456789 (ok) [done]"},
+		{"cyrillic", u8"Съешь же ещё этих мягких французских булок, да выпей же чаю. Ёжик"},
+		{"cjk",      u8"我能吞下玻璃而不伤身体。私はガラスを食べられます。나는 유리를 먹을 수 있어요"},
+		{"emoji",    u8"😀😃😄😁😆😅🤣😂🙂🙃😉😊😇🥰😍🤩😘😗😚😋😛😜🤪😝🤑🤗🤭🤫🤔"},
+		{"chat",     u8"[12:04] Вася: lol 😂 see you at 8pm near 東京 station 👍 ok? ну давай"},
+	};
+
+	struct Result {
+		std::string Name;
+		std::string Corpus;
+		std::size_t Iterations = 0;
+		double NsPerOp = 0.0;
+	};
+
+	std::vector<Result> Results;
+
+	sf::String FromUtf8(const char *utf8){
+		std::string string(utf8);
+		return sf::String::fromUtf8(string.begin(), string.end());
+	}
+
+	// Runs 'operation' until at least 'min_time' elapsed, reports the mean time of one call
+	void Measure(const std::string &name, const std::string &corpus, const std::function<void()> &operation, double min_time = 0.2){
+		operation();
+
+		std::size_t iterations = 0;
+		auto begin = Clock::now();
+		double elapsed = 0.0;
+
+		do {
+			operation();
+			iterations++;
+			elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+		} while (elapsed < min_time);
+
+		Results.push_back({name, corpus, iterations, elapsed * 1e9 / iterations});
+		std::cerr << name << " [" << corpus << "] " << Results.back().NsPerOp << " ns\n";
+	}
+
+	void Record(const std::string &name, const std::string &corpus, std::size_t iterations, double seconds){
+		Results.push_back({name, corpus, iterations, seconds * 1e9 / iterations});
+		std::cerr << name << " [" << corpus << "] " << Results.back().NsPerOp << " ns\n";
+	}
+
+	std::vector<ColorFont> LoadFonts(const std::vector<std::string> &paths, std::size_t count){
+		std::vector<ColorFont> fonts;
+
+		for (std::size_t i = 0; i < count; i++) {
+			ColorFont font;
+			font.loadFromFile(paths[std::min(i, paths.size() - 1)]);
+			fonts.push_back(std::move(font));
+		}
+
+		return fonts;
+	}
+
+	// Exposes the layout step alone
+	struct BuildProbe: RichTextLine {
+		using RichTextLine::build;
+	};
+
+	void WriteJson(std::ostream &out){
+		out << "{\n  \"results\": [\n";
+
+		for (std::size_t i = 0; i < Results.size(); i++) {
+			const Result &result = Results[i];
+			out << "    {\"name\": \"" << result.Name << "\", \"corpus\": \"" << result.Corpus
+				<< "\", \"iterations\": " << result.Iterations << ", \"ns_per_op\": " << result.NsPerOp << "}"
+				<< (i + 1 < Results.size() ? ",\n" : "\n");
+		}
+
+		out << "  ]\n}\n";
+	}
+}
+
+int main(int argc, char **argv){
+	if(argc < 3){
+		std::cerr << "Usage: " << argv[0] << " <output.json> <font> [fallback fonts...]\n";
+		return 1;
+	}
+
+	const std::vector<std::string> paths(argv + 2, argv + argc);
+	const unsigned int size = 24;
+
+	for (const Corpus &corpus : Corpora) {
+		const sf::String string = FromUtf8(corpus.Utf8);
+		RichFont rich_font(LoadFonts(paths, paths.size()));
+
+		// Cold: every glyph gets rasterized and packed into a fresh page
+		{
+			std::size_t glyphs = 0;
+			double seconds = 0.0;
+
+			for (unsigned int cold_size = 10; cold_size < 60; cold_size++) {
+				auto begin = Clock::now();
+				for(sf::Uint32 character: string)
+					rich_font.findFontForGlyph(character)->getGlyph(character, cold_size, false);
+				seconds += std::chrono::duration<double>(Clock::now() - begin).count();
+				glyphs += string.getSize();
+			}
+
+			Record("ColorFont::getGlyph cold", corpus.Name, glyphs, seconds);
+		}
+
+		Measure("ColorFont::getGlyph warm", corpus.Name, [&](){
+			for(sf::Uint32 character: string)
+				rich_font.findFontForGlyph(character)->getGlyph(character, size, false);
+		});
+
+		Measure("ColorFont::getKerning", corpus.Name, [&](){
+			for (std::size_t i = 1; i < string.getSize(); i++)
+				rich_font.findFontForGlyph(string[i])->getKerning(string[i - 1], string[i], size);
+		});
+
+		// Alternating strings defeat the unchanged string short circuit, so every call lays the text out again
+		ColorText text(string, *rich_font.findFontForGlyph(string[0]), size);
+		const sf::String other = string + sf::String(L"!");
+		bool flip = false;
+		Measure("ColorText::ensureGeometryUpdate", corpus.Name, [&](){
+			text.setString((flip = !flip) ? other : string);
+			text.getLocalBounds();
+		});
+
+		for (std::size_t fallbacks = 1; fallbacks <= 5; fallbacks++) {
+			RichFont fallback_font(LoadFonts(paths, fallbacks));
+			// Warm the caches, only the layout is measured
+			BuildProbe::build(fallback_font, string, size);
+
+			Measure("RichTextLine::build " + std::to_string(fallbacks) + " fonts", corpus.Name, [&](){
+				BuildProbe::build(fallback_font, string, size);
+			});
+		}
+
+		ElipsisRichTextLine elipsis;
+		elipsis.setRichFont(rich_font);
+		elipsis.setCharacterSize(size);
+		elipsis.setMaxWidth(static_cast<int>(rich_font.measure(string, size).Advance / 2));
+		Measure("ElipsisRichTextLine::rebuild", corpus.Name, [&](){
+			elipsis.setString((flip = !flip) ? other : string);
+			elipsis.getLocalBounds();
+		});
+	}
+
+	// Packing: distinct CJK ideographs at a fresh size, the page fills up and grows
+	{
+		std::vector<ColorFont> fonts = LoadFonts(paths, paths.size());
+		const ColorFont *font = &fonts.front();
+		for (const auto &candidate : fonts) {
+			if(candidate.hasGlyph(0x4E00)){
+				font = &candidate;
+				break;
+			}
+		}
+
+		const std::size_t count = 4000;
+		auto begin = Clock::now();
+		for (sf::Uint32 character = 0x4E00; character < 0x4E00 + count; character++)
+			font->getGlyph(character, 32, false);
+		Record("findGlyphRect packing", "cjk-ideographs", count, std::chrono::duration<double>(Clock::now() - begin).count());
+	}
+
+	// Draw throughput into an offscreen target, reading the pixels back waits for the GPU to finish
+	{
+		sf::RenderTexture target;
+		if (target.create(1024, 1024)) {
+			RichFont rich_font(LoadFonts(paths, paths.size()));
+
+			for (const Corpus &corpus : Corpora) {
+				std::vector<RichTextLine> lines(40);
+				for (std::size_t i = 0; i < lines.size(); i++) {
+					lines[i].setRichFont(rich_font);
+					lines[i].setCharacterSize(size);
+					lines[i].setString(FromUtf8(corpus.Utf8));
+					lines[i].setPosition(0.f, static_cast<float>(i * 25));
+				}
+
+				const std::size_t frames = 100;
+				auto begin = Clock::now();
+				for (std::size_t frame = 0; frame < frames; frame++) {
+					target.clear();
+					for(const auto &line: lines)
+						target.draw(line);
+					target.display();
+				}
+				target.getTexture().copyToImage();
+
+				Record("draw 40 lines", corpus.Name, frames, std::chrono::duration<double>(Clock::now() - begin).count());
+			}
+		} else {
+			std::cerr << "Offscreen target unavailable, draw benchmark skipped\n";
+		}
+	}
+
+	std::ofstream output(argv[1]);
+	WriteJson(output);
+
+	return 0;
+}
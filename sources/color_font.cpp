@@ -1,4 +1,6 @@
 #include "color_font.hpp"
+#include "font_coverage.hpp"
+#include "shared_glyph_cache.hpp"
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
@@ -9,8 +11,16 @@
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
 #include <SFML/System/Err.hpp>
 #include <SFML/System/InputStream.hpp>
+#include <SFML/Window/GlResource.hpp>
+#include <SFML/OpenGL.hpp>
+#include <tuple>
+
+#if !defined(GL_TEXTURE_MAX_LEVEL) && !defined(SFML_OPENGL_ES)
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#endif
 
 namespace
 {
@@ -47,6 +57,282 @@ namespace
     {
         return (static_cast<sf::Uint64>(reinterpret<sf::Uint32>(outlineThickness)) << 32) | (static_cast<sf::Uint64>(bold) << 31) | index;
     }
+
+    // Flattens an outline into closed polygons, in pixels with the y axis pointing down
+    struct OutlineFlattener
+    {
+        std::vector<std::vector<sf::Vector2f> > contours;
+        sf::Vector2f last;
+
+        static sf::Vector2f point(const FT_Vector* vector)
+        {
+            return sf::Vector2f(static_cast<float>(vector->x) / 64.f, -static_cast<float>(vector->y) / 64.f);
+        }
+
+        // Number of segments keeping a curve within a quarter pixel of its polygon
+        static int segments(sf::Vector2f deviation)
+        {
+            float distance = std::sqrt(deviation.x * deviation.x + deviation.y * deviation.y);
+            return std::max(1, std::min(64, static_cast<int>(std::ceil(std::sqrt(distance / 0.25f)))));
+        }
+
+        static int moveTo(const FT_Vector* to, void* user)
+        {
+            OutlineFlattener& self = *static_cast<OutlineFlattener*>(user);
+            self.last = point(to);
+            self.contours.push_back(std::vector<sf::Vector2f>(1, self.last));
+            return 0;
+        }
+
+        static int lineTo(const FT_Vector* to, void* user)
+        {
+            OutlineFlattener& self = *static_cast<OutlineFlattener*>(user);
+            self.last = point(to);
+            self.contours.back().push_back(self.last);
+            return 0;
+        }
+
+        static int conicTo(const FT_Vector* control, const FT_Vector* to, void* user)
+        {
+            OutlineFlattener& self = *static_cast<OutlineFlattener*>(user);
+            sf::Vector2f p0 = self.last, p1 = point(control), p2 = point(to);
+
+            int count = segments(p0 - 2.f * p1 + p2);
+            for (int i = 1; i <= count; ++i)
+            {
+                float t = static_cast<float>(i) / static_cast<float>(count), u = 1.f - t;
+                self.contours.back().push_back(u * u * p0 + 2.f * u * t * p1 + t * t * p2);
+            }
+
+            self.last = p2;
+            return 0;
+        }
+
+        static int cubicTo(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user)
+        {
+            OutlineFlattener& self = *static_cast<OutlineFlattener*>(user);
+            sf::Vector2f p0 = self.last, p1 = point(control1), p2 = point(control2), p3 = point(to);
+
+            sf::Vector2f d1 = p0 - 2.f * p1 + p2, d2 = p1 - 2.f * p2 + p3;
+            int count = segments(1.5f * (std::abs(d1.x) + std::abs(d1.y) > std::abs(d2.x) + std::abs(d2.y) ? d1 : d2));
+            for (int i = 1; i <= count; ++i)
+            {
+                float t = static_cast<float>(i) / static_cast<float>(count), u = 1.f - t;
+                self.contours.back().push_back(u * u * u * p0 + 3.f * u * u * t * p1 + 3.f * u * t * t * p2 + t * t * t * p3);
+            }
+
+            self.last = p3;
+            return 0;
+        }
+    };
+
+    // Fills polygons with trapezoids: the plane is cut into horizontal slabs at every vertex and every
+    // edge crossing, so that inside a slab edges never cross and the spans to fill follow from the winding
+    std::vector<sf::Vector2f> tessellate(const std::vector<std::vector<sf::Vector2f> >& contours, bool evenOdd)
+    {
+        struct Edge
+        {
+            sf::Vector2f top;
+            sf::Vector2f bottom;
+            int          winding;
+
+            float xAt(float y) const
+            {
+                return top.x + (bottom.x - top.x) * (y - top.y) / (bottom.y - top.y);
+            }
+        };
+
+        std::vector<Edge> edges;
+        std::vector<float> cuts;
+
+        for (std::size_t c = 0; c < contours.size(); ++c)
+        {
+            const std::vector<sf::Vector2f>& contour = contours[c];
+            for (std::size_t i = 0; i < contour.size(); ++i)
+            {
+                sf::Vector2f a = contour[i], b = contour[(i + 1) % contour.size()];
+                cuts.push_back(a.y);
+
+                // Horizontal edges never bound a span
+                if (a.y == b.y)
+                    continue;
+
+                Edge edge = a.y < b.y ? Edge{a, b, 1} : Edge{b, a, -1};
+                edges.push_back(edge);
+            }
+        }
+
+        for (std::size_t i = 0; i < edges.size(); ++i)
+        {
+            for (std::size_t j = i + 1; j < edges.size(); ++j)
+            {
+                const Edge& e = edges[i];
+                const Edge& f = edges[j];
+
+                float top    = std::max(e.top.y, f.top.y);
+                float bottom = std::min(e.bottom.y, f.bottom.y);
+                if (top >= bottom)
+                    continue;
+
+                // The edges swap their order inside their common range: they cross there
+                float dTop    = e.xAt(top) - f.xAt(top);
+                float dBottom = e.xAt(bottom) - f.xAt(bottom);
+                if ((dTop < 0 && dBottom > 0) || (dTop > 0 && dBottom < 0))
+                    cuts.push_back(top + (bottom - top) * dTop / (dTop - dBottom));
+            }
+        }
+
+        std::sort(cuts.begin(), cuts.end());
+        cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+        std::vector<sf::Vector2f> triangles;
+        std::vector<std::pair<float, const Edge*> > active;
+
+        for (std::size_t s = 0; s + 1 < cuts.size(); ++s)
+        {
+            float y0 = cuts[s], y1 = cuts[s + 1], middle = (y0 + y1) / 2.f;
+
+            active.clear();
+            for (std::size_t i = 0; i < edges.size(); ++i)
+            {
+                if (edges[i].top.y <= y0 && edges[i].bottom.y >= y1)
+                    active.push_back(std::make_pair(edges[i].xAt(middle), &edges[i]));
+            }
+
+            std::sort(active.begin(), active.end(), [](const std::pair<float, const Edge*>& a, const std::pair<float, const Edge*>& b) { return a.first < b.first; });
+
+            int winding = 0;
+            for (std::size_t i = 0; i + 1 < active.size(); ++i)
+            {
+                winding += active[i].second->winding;
+
+                bool inside = evenOdd ? (winding & 1) != 0 : winding != 0;
+                if (!inside)
+                    continue;
+
+                const Edge& left  = *active[i].second;
+                const Edge& right = *active[i + 1].second;
+
+                sf::Vector2f topLeft(left.xAt(y0), y0), topRight(right.xAt(y0), y0);
+                sf::Vector2f bottomLeft(left.xAt(y1), y1), bottomRight(right.xAt(y1), y1);
+
+                triangles.push_back(topLeft);
+                triangles.push_back(topRight);
+                triangles.push_back(bottomLeft);
+                triangles.push_back(bottomLeft);
+                triangles.push_back(topRight);
+                triangles.push_back(bottomRight);
+            }
+        }
+
+        return triangles;
+    }
+
+    // Character size 0 is never requested, so its slot in the page table holds the shared color strike page
+    const unsigned int StrikePage = 0;
+
+    // Padding around the glyphs of the strike page. Each mipmap level halves it, so sampling
+    // stops at the level where a single texel is left, the next ones would blend neighbors
+    const unsigned int StrikePadding  = 8;
+    const int          StrikeMaxLevel = 3;
+
+    // Largest texture size reported by the render thread: pages grow on any thread, which can't
+    // ask OpenGL. Until a page is flushed for the first time, a size every desktop GPU supports
+    std::atomic<unsigned int> maximumTextureSize(4096);
+
+    // Raw OpenGL access to the single channel glyph pages: sf::Texture only
+    // creates RGBA storage, so alpha pages are respecified and updated directly
+    class AlphaTexture : sf::GlResource
+    {
+    public:
+
+        // Replace the storage of the texture by an alpha-only one of the same size
+        void create(sf::Texture& texture, const sf::Uint8* pixels)
+        {
+            TransientContextLock lock;
+            Binding binding(texture);
+
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA8, static_cast<GLsizei>(texture.getSize().x), static_cast<GLsizei>(texture.getSize().y), 0, GL_ALPHA, GL_UNSIGNED_BYTE, pixels);
+        }
+
+        // Write one byte per pixel into a region of the texture
+        void update(sf::Texture& texture, const sf::Uint8* pixels, unsigned int width, unsigned int height, unsigned int x, unsigned int y)
+        {
+            TransientContextLock lock;
+            Binding binding(texture);
+
+            glTexSubImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(x), static_cast<GLint>(y), static_cast<GLsizei>(width), static_cast<GLsizei>(height), GL_ALPHA, GL_UNSIGNED_BYTE, pixels);
+            glFlush();
+        }
+
+        // Give the destination alpha storage and copy the source pixels into its top-left corner
+        void copy(const sf::Texture& source, sf::Texture& destination)
+        {
+            std::vector<sf::Uint8> pixels(source.getSize().x * source.getSize().y);
+
+            {
+                TransientContextLock lock;
+                Binding binding(source);
+
+                glGetTexImage(GL_TEXTURE_2D, 0, GL_ALPHA, GL_UNSIGNED_BYTE, &pixels[0]);
+            }
+
+            std::vector<sf::Uint8> empty(destination.getSize().x * destination.getSize().y, 0);
+            create(destination, &empty[0]);
+            update(destination, &pixels[0], source.getSize().x, source.getSize().y, 0, 0);
+        }
+
+    private:
+
+        // Bind a texture with tightly packed rows, restoring the previous state on destruction
+        // so that the texture cache of the render targets stays valid
+        struct Binding
+        {
+            explicit Binding(const sf::Texture& texture)
+            {
+                glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+                glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousUnpack);
+                glGetIntegerv(GL_PACK_ALIGNMENT, &previousPack);
+                glBindTexture(GL_TEXTURE_2D, texture.getNativeHandle());
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            }
+
+            ~Binding()
+            {
+                glPixelStorei(GL_UNPACK_ALIGNMENT, previousUnpack);
+                glPixelStorei(GL_PACK_ALIGNMENT, previousPack);
+                glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previousTexture));
+            }
+
+            GLint previousTexture;
+            GLint previousUnpack;
+            GLint previousPack;
+        };
+    };
+
+    // Raw OpenGL access to the mipmap range, sf::Texture always samples the whole chain
+    class MipmapRange : sf::GlResource
+    {
+    public:
+
+        // Keep the sampler off the levels past 'maxLevel'
+        void limit(const sf::Texture& texture, int maxLevel)
+        {
+            #ifdef GL_TEXTURE_MAX_LEVEL
+            TransientContextLock lock;
+
+            GLint previousTexture;
+            glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+            glBindTexture(GL_TEXTURE_2D, texture.getNativeHandle());
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxLevel);
+            glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previousTexture));
+            #else
+            (void)texture;
+            (void)maxLevel;
+            #endif
+        }
+    };
 }
 
 using namespace sf;
@@ -57,8 +343,15 @@ m_face     (NULL),
 m_streamRec(NULL),
 m_stroker  (NULL),
 m_refCount (NULL),
+m_faceMutex(NULL),
 m_isSmooth (true),
-m_info     ()
+m_info     (),
+m_vectorThreshold(120),
+m_nextPageId(1),
+m_frame    (0),
+m_stats    (&RichTextCounters::global()),
+m_sharedCache(NULL),
+m_contentHash(0)
 {
     #ifdef SFML_SYSTEM_ANDROID
         m_stream = NULL;
@@ -73,10 +366,22 @@ m_face       (copy.m_face),
 m_streamRec  (copy.m_streamRec),
 m_stroker    (copy.m_stroker),
 m_refCount   (copy.m_refCount),
+m_faceMutex  (copy.m_faceMutex),
 m_isSmooth   (copy.m_isSmooth),
 m_info       (copy.m_info),
 m_pages      (copy.m_pages),
-m_pixelBuffer(copy.m_pixelBuffer)
+m_strikeGlyphs(copy.m_strikeGlyphs),
+m_metrics    (copy.m_metrics),
+m_meshes     (copy.m_meshes),
+m_indices    (copy.m_indices),
+m_kerning    (copy.m_kerning),
+m_vectorThreshold(copy.m_vectorThreshold),
+m_meshUse    (copy.m_meshUse),
+m_nextPageId (copy.m_nextPageId),
+m_frame      (copy.m_frame),
+m_stats      (copy.m_stats),
+m_sharedCache(copy.m_sharedCache),
+m_contentHash(copy.m_contentHash)
 {
     #ifdef SFML_SYSTEM_ANDROID
         m_stream = NULL;
@@ -106,12 +411,20 @@ ColorFont::~ColorFont()
 
 ////////////////////////////////////////////////////////////
 bool ColorFont::loadFromFile(const std::string& filename)
+{
+    return loadFromFile(filename, 0);
+}
+
+
+////////////////////////////////////////////////////////////
+bool ColorFont::loadFromFile(const std::string& filename, sf::Uint64 contentHash)
 {
     #ifndef SFML_SYSTEM_ANDROID
 
     // Cleanup the previous resources
     cleanup();
     m_refCount = new int(1);
+    m_faceMutex = new std::recursive_mutex;
 
     // Initialize FreeType
     // Note: we initialize FreeType for every font instance in order to avoid having a single
@@ -157,6 +470,14 @@ bool ColorFont::loadFromFile(const std::string& filename)
     // Store the font information
     m_info.family = face->family_name ? face->family_name : std::string();
 
+    // Identifies the glyphs of this file in the shared cache, whatever its path in each process
+    m_contentHash = contentHash;
+    if (!m_contentHash && m_sharedCache)
+    {
+        std::optional<FontFileStamp> stamp = FontFileStamp::fromFile(filename);
+        m_contentHash = stamp ? stamp->Hash : 0;
+    }
+
     return true;
 
     #else
@@ -165,7 +486,12 @@ bool ColorFont::loadFromFile(const std::string& filename)
         delete static_cast<priv::ResourceStream*>(m_stream);
 
     m_stream = new priv::ResourceStream(filename);
-    return loadFromStream(*static_cast<priv::ResourceStream*>(m_stream));
+    if (!loadFromStream(*static_cast<priv::ResourceStream*>(m_stream)))
+        return false;
+
+    // Streams aren't hashed, only a known hash shares the glyphs
+    m_contentHash = contentHash;
+    return true;
 
     #endif
 }
@@ -177,6 +503,7 @@ bool ColorFont::loadFromMemory(const void* data, std::size_t sizeInBytes)
     // Cleanup the previous resources
     cleanup();
     m_refCount = new int(1);
+    m_faceMutex = new std::recursive_mutex;
 
     // Initialize FreeType
     // Note: we initialize FreeType for every font instance in order to avoid having a single
@@ -222,6 +549,8 @@ bool ColorFont::loadFromMemory(const void* data, std::size_t sizeInBytes)
     // Store the font information
     m_info.family = face->family_name ? face->family_name : std::string();
 
+    m_contentHash = m_sharedCache ? FontFileStamp::fromMemory(data, sizeInBytes).Hash : 0;
+
     return true;
 }
 
@@ -232,6 +561,7 @@ bool ColorFont::loadFromStream(InputStream& stream)
     // Cleanup the previous resources
     cleanup();
     m_refCount = new int(1);
+    m_faceMutex = new std::recursive_mutex;
 
     // Initialize FreeType
     // Note: we initialize FreeType for every font instance in order to avoid having a single
@@ -314,32 +644,227 @@ const sf::Font::Info& ColorFont::getInfo() const
 ////////////////////////////////////////////////////////////
 const Glyph& ColorFont::getGlyph(Uint32 codePoint, unsigned int characterSize, bool bold, float outlineThickness) const
 {
-    // Get the page corresponding to the character size
-    GlyphTable& glyphs = loadPage(characterSize).glyphs;
+    // Color bitmap fonts share a single atlas between all the character sizes
+    if (hasColorStrikes())
+        return getStrikeGlyph(codePoint, characterSize, bold, outlineThickness);
 
     // Build the key by combining the glyph index (based on code point), bold flag, and outline thickness
-    Uint64 key = combine(outlineThickness, bold, FT_Get_Char_Index(static_cast<FT_Face>(m_face), codePoint));
+    Uint64 key = combine(outlineThickness, bold, getGlyphIndex(codePoint));
 
-    // Search the glyph into the cache
-    GlyphTable::const_iterator it = glyphs.find(key);
-    if (it != glyphs.end())
+    // Search the glyph into the cache of the page corresponding to the character size
     {
-        // Found: just return it
-        return it->second;
+        std::shared_lock<std::shared_mutex> lock(m_tableMutex);
+
+        PageTable::const_iterator page = m_pages.find(characterSize);
+        if (page != m_pages.end())
+        {
+            page->second.lastUse.store(m_frame.load());
+
+            GlyphTable::const_iterator it = page->second.glyphs.find(key);
+            if (it != page->second.glyphs.end())
+            {
+                // Found: just return it
+                RICH_TEXT_COUNT(m_stats, GlyphCacheHits, 1);
+                return it->second;
+            }
+        }
     }
-    else
+
+    // Not found: we have to load it
+    RICH_TEXT_COUNT(m_stats, GlyphCacheMisses, 1);
+    return loadGlyph(codePoint, characterSize, bold, outlineThickness, key);
+}
+
+
+////////////////////////////////////////////////////////////
+const Glyph& ColorFont::getStrikeGlyph(Uint32 codePoint, unsigned int characterSize, bool bold, float outlineThickness) const
+{
+    Uint64 key = combine(outlineThickness, bold, getGlyphIndex(codePoint));
+
+    const Glyph* native = NULL;
+
+    {
+        std::shared_lock<std::shared_mutex> lock(m_tableMutex);
+
+        std::map<unsigned int, GlyphTable>::const_iterator glyphs = m_strikeGlyphs.find(characterSize);
+        if (glyphs != m_strikeGlyphs.end())
+        {
+            GlyphTable::const_iterator it = glyphs->second.find(key);
+            if (it != glyphs->second.end())
+            {
+                RICH_TEXT_COUNT(m_stats, GlyphCacheHits, 1);
+                return it->second;
+            }
+        }
+
+        // An other size may already have rasterized the glyph
+        PageTable::const_iterator page = m_pages.find(StrikePage);
+        if (page != m_pages.end())
+        {
+            GlyphTable::const_iterator it = page->second.glyphs.find(key);
+            if (it != page->second.glyphs.end())
+                native = &it->second;
+        }
+    }
+
+    RICH_TEXT_COUNT(m_stats, GlyphCacheMisses, 1);
+
+    // Rasterize the glyph at the native strike size, unless an other size already did it
+    unsigned int strikeSize = getStrikeSize();
+
+    if (!native)
+        native = &loadGlyph(codePoint, strikeSize, bold, outlineThickness, key);
+
+    // Only the metrics follow the requested size, the texture rect keeps
+    // pointing to the native bitmap which the GPU minifies when drawing
+    float scale = static_cast<float>(characterSize) / static_cast<float>(strikeSize);
+
+    Glyph glyph = *native;
+    glyph.advance       *= scale;
+    glyph.lsbDelta       = static_cast<int>(static_cast<float>(glyph.lsbDelta) * scale);
+    glyph.rsbDelta       = static_cast<int>(static_cast<float>(glyph.rsbDelta) * scale);
+    glyph.bounds.left   *= scale;
+    glyph.bounds.top    *= scale;
+    glyph.bounds.width  *= scale;
+    glyph.bounds.height *= scale;
+
+    std::unique_lock<std::shared_mutex> lock(m_tableMutex);
+    return m_strikeGlyphs[characterSize].insert(std::make_pair(key, glyph)).first->second;
+}
+
+
+////////////////////////////////////////////////////////////
+const Glyph& ColorFont::getGlyphMetrics(Uint32 codePoint, unsigned int characterSize, bool bold) const
+{
+    unsigned int index = getGlyphIndex(codePoint);
+    Uint64 key = combine(0, bold, index);
+
+    {
+        std::shared_lock<std::shared_mutex> lock(m_tableMutex);
+
+        std::map<unsigned int, GlyphTable>::const_iterator glyphs = m_metrics.find(characterSize);
+        if (glyphs != m_metrics.end())
+        {
+            GlyphTable::const_iterator it = glyphs->second.find(key);
+            if (it != glyphs->second.end())
+                return it->second;
+        }
+    }
+
+    Glyph glyph;
+    {
+        std::unique_lock<std::recursive_mutex> faceLock = lockFace();
+        glyph = loadGlyphMetrics(index, characterSize, bold);
+    }
+
+    // If an other thread loaded the same metrics meanwhile, its entry is kept
+    std::unique_lock<std::shared_mutex> lock(m_tableMutex);
+    return m_metrics[characterSize].insert(std::make_pair(key, glyph)).first->second;
+}
+
+
+////////////////////////////////////////////////////////////
+void ColorFont::preloadGlyphMetrics(const Uint32* codePoints, std::size_t count, unsigned int characterSize, bool bold) const
+{
+    FT_Face face = static_cast<FT_Face>(m_face);
+    if (!face)
+        return;
+
+    // Holding the face for the whole batch keeps other threads from switching
+    // its size between the loads, the lock is recursive
+    std::unique_lock<std::recursive_mutex> faceLock = lockFace();
+
+    for (std::size_t i = 0; i < count; ++i)
+        getGlyphMetrics(codePoints[i], characterSize, bold);
+}
+
+
+////////////////////////////////////////////////////////////
+const std::vector<Vector2f>& ColorFont::getGlyphMesh(Uint32 codePoint, unsigned int characterSize, bool bold, float outlineThickness) const
+{
+    unsigned int index = getGlyphIndex(codePoint);
+    Uint64 key = combine(outlineThickness, bold, index);
+
     {
-        // Not found: we have to load it
-        Glyph glyph = loadGlyph(codePoint, characterSize, bold, outlineThickness);
-        return glyphs.insert(std::make_pair(key, glyph)).first->second;
+        std::shared_lock<std::shared_mutex> lock(m_tableMutex);
+
+        std::map<unsigned int, MeshTable>::const_iterator meshes = m_meshes.find(characterSize);
+        if (meshes != m_meshes.end())
+        {
+            m_meshUse.find(characterSize)->second.store(m_frame.load());
+
+            MeshTable::const_iterator it = meshes->second.find(key);
+            if (it != meshes->second.end())
+                return it->second;
+        }
     }
+
+    std::vector<Vector2f> mesh;
+    {
+        std::unique_lock<std::recursive_mutex> faceLock = lockFace();
+        mesh = loadGlyphMesh(index, characterSize, bold, outlineThickness);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_tableMutex);
+    m_meshUse[characterSize].store(m_frame.load());
+    return m_meshes[characterSize].insert(std::make_pair(key, std::move(mesh))).first->second;
+}
+
+
+////////////////////////////////////////////////////////////
+void ColorFont::setVectorThreshold(unsigned int characterSize)
+{
+    m_vectorThreshold = characterSize;
+}
+
+
+////////////////////////////////////////////////////////////
+void ColorFont::setSharedGlyphCache(SharedGlyphCache* cache)
+{
+    m_sharedCache = cache;
+}
+
+
+////////////////////////////////////////////////////////////
+bool ColorFont::isVectorSize(unsigned int characterSize) const
+{
+    FT_Face face = static_cast<FT_Face>(m_face);
+
+    return face && characterSize >= m_vectorThreshold && FT_IS_SCALABLE(face) && !FT_HAS_COLOR(face);
 }
 
 
 ////////////////////////////////////////////////////////////
 bool ColorFont::hasGlyph(Uint32 codePoint) const
 {
-    return FT_Get_Char_Index(static_cast<FT_Face>(m_face), codePoint) != 0;
+    return getGlyphIndex(codePoint) != 0;
+}
+
+
+////////////////////////////////////////////////////////////
+std::vector<std::pair<Uint32, Uint32> > ColorFont::getCodePointRanges() const
+{
+    std::vector<std::pair<Uint32, Uint32> > ranges;
+
+    FT_Face face = static_cast<FT_Face>(m_face);
+    if (!face)
+        return ranges;
+
+    std::unique_lock<std::recursive_mutex> faceLock = lockFace();
+
+    // Character codes come in increasing order, consecutive ones are merged
+    FT_UInt index = 0;
+    for (FT_ULong code = FT_Get_First_Char(face, &index); index != 0; code = FT_Get_Next_Char(face, code, &index))
+    {
+        Uint32 codePoint = static_cast<Uint32>(code);
+
+        if (!ranges.empty() && ranges.back().second + 1 == codePoint)
+            ranges.back().second = codePoint;
+        else
+            ranges.push_back(std::make_pair(codePoint, codePoint));
+    }
+
+    return ranges;
 }
 
 
@@ -352,29 +877,26 @@ float ColorFont::getKerning(Uint32 first, Uint32 second, unsigned int characterS
 
     FT_Face face = static_cast<FT_Face>(m_face);
 
-    if (face && setCurrentSize(characterSize))
+    if (face)
     {
         // Convert the characters to indices
-        FT_UInt index1 = FT_Get_Char_Index(face, first);
-        FT_UInt index2 = FT_Get_Char_Index(face, second);
+        unsigned int index1 = getGlyphIndex(first);
+        unsigned int index2 = getGlyphIndex(second);
 
         // Retrieve position compensation deltas generated by FT_LOAD_FORCE_AUTOHINT flag
-        float firstRsbDelta = static_cast<float>(getGlyph(first, characterSize, bold).rsbDelta);
-        float secondLsbDelta = static_cast<float>(getGlyph(second, characterSize, bold).lsbDelta);
+        float firstRsbDelta = static_cast<float>(getGlyphMetrics(first, characterSize, bold).rsbDelta);
+        float secondLsbDelta = static_cast<float>(getGlyphMetrics(second, characterSize, bold).lsbDelta);
 
         // Get the kerning vector if present
-        FT_Vector kerning;
-        kerning.x = kerning.y = 0;
-        if (FT_HAS_KERNING(face))
-            FT_Get_Kerning(face, index1, index2, FT_KERNING_UNFITTED, &kerning);
+        long kerning = FT_HAS_KERNING(face) ? getPairKerning(index1, index2, characterSize) : 0;
 
         // X advance is already in pixels for bitmap fonts
         if (!FT_IS_SCALABLE(face))
-            return static_cast<float>(kerning.x);
+            return static_cast<float>(kerning);
 
         // Combine kerning with compensation deltas and return the X advance
         // Flooring is required as we use FT_KERNING_UNFITTED flag which is not quantized in 64 based grid
-        return std::floor((secondLsbDelta - firstRsbDelta + static_cast<float>(kerning.x) + 32) / static_cast<float>(1 << 6));
+        return std::floor((secondLsbDelta - firstRsbDelta + static_cast<float>(kerning) + 32) / static_cast<float>(1 << 6));
     }
     else
     {
@@ -388,6 +910,7 @@ float ColorFont::getKerning(Uint32 first, Uint32 second, unsigned int characterS
 float ColorFont::getLineSpacing(unsigned int characterSize) const
 {
     FT_Face face = static_cast<FT_Face>(m_face);
+    std::unique_lock<std::recursive_mutex> faceLock = lockFace();
 
     if (face && setCurrentSize(characterSize))
     {
@@ -404,6 +927,7 @@ float ColorFont::getLineSpacing(unsigned int characterSize) const
 float ColorFont::getUnderlinePosition(unsigned int characterSize) const
 {
     FT_Face face = static_cast<FT_Face>(m_face);
+    std::unique_lock<std::recursive_mutex> faceLock = lockFace();
 
     if (face && setCurrentSize(characterSize))
     {
@@ -424,6 +948,7 @@ float ColorFont::getUnderlinePosition(unsigned int characterSize) const
 float ColorFont::getUnderlineThickness(unsigned int characterSize) const
 {
     FT_Face face = static_cast<FT_Face>(m_face);
+    std::unique_lock<std::recursive_mutex> faceLock = lockFace();
 
     if (face && setCurrentSize(characterSize))
     {
@@ -443,7 +968,29 @@ float ColorFont::getUnderlineThickness(unsigned int characterSize) const
 ////////////////////////////////////////////////////////////
 const Texture& ColorFont::getTexture(unsigned int characterSize) const
 {
-    return loadPage(characterSize).texture;
+    const bool strike = hasColorStrikes();
+    const unsigned int pageSize = strike ? StrikePage : characterSize;
+
+    // Nothing pending: the texture can be returned without blocking the other readers
+    {
+        std::shared_lock<std::shared_mutex> lock(m_tableMutex);
+
+        PageTable::const_iterator page = m_pages.find(pageSize);
+        if (page != m_pages.end() && page->second.uploads.empty() && !page->second.mipmapOutdated && page->second.texture.getSize() == page->second.size)
+        {
+            page->second.lastUse.store(m_frame.load());
+            return page->second.texture;
+        }
+    }
+
+    // Glyphs loaded by any thread are written here, on the render thread. Smaller sizes sample
+    // the strike page through its mipmaps, which are regenerated along
+    std::unique_lock<std::shared_mutex> lock(m_tableMutex);
+
+    Page& page = loadPage(pageSize);
+    flushPage(page, strike);
+
+    return page.texture;
 }
 
 ////////////////////////////////////////////////////////////
@@ -453,6 +1000,8 @@ void ColorFont::setSmooth(bool smooth)
     {
         m_isSmooth = smooth;
 
+        std::unique_lock<std::shared_mutex> lock(m_tableMutex);
+
         for (PageTable::iterator page = m_pages.begin(); page != m_pages.end(); ++page)
         {
             page->second.texture.setSmooth(m_isSmooth);
@@ -477,42 +1026,256 @@ bool ColorFont::isColorEmojiFont() const
 
 
 ////////////////////////////////////////////////////////////
-ColorFont& ColorFont::operator =(const ColorFont& right)
+bool ColorFont::hasColorStrikes() const
 {
-    ColorFont temp(right);
+    FT_Face face = static_cast<FT_Face>(m_face);
 
-    std::swap(m_library,     temp.m_library);
-    std::swap(m_face,        temp.m_face);
-    std::swap(m_streamRec,   temp.m_streamRec);
-    std::swap(m_stroker,     temp.m_stroker);
-    std::swap(m_refCount,    temp.m_refCount);
-    std::swap(m_isSmooth,    temp.m_isSmooth);
-    std::swap(m_info,        temp.m_info);
-    std::swap(m_pages,       temp.m_pages);
-    std::swap(m_pixelBuffer, temp.m_pixelBuffer);
+    return face && FT_HAS_COLOR(face) && FT_HAS_FIXED_SIZES(face);
+}
 
-    #ifdef SFML_SYSTEM_ANDROID
-        std::swap(m_stream, temp.m_stream);
-    #endif
 
-    return *this;
+////////////////////////////////////////////////////////////
+unsigned int ColorFont::getStrikeSize() const
+{
+    FT_Face face = static_cast<FT_Face>(m_face);
+
+    FT_Short largest = 0;
+    for (int i = 0; i < face->num_fixed_sizes; ++i)
+        largest = std::max(largest, face->available_sizes[i].height);
+
+    return static_cast<unsigned int>(largest);
 }
 
 
 ////////////////////////////////////////////////////////////
-void ColorFont::cleanup()
+Uint64 ColorFont::getPageId(unsigned int characterSize) const
 {
-    // Check if we must destroy the FreeType pointers
-    if (m_refCount)
-    {
-        // Decrease the reference counter
-        (*m_refCount)--;
+    std::shared_lock<std::shared_mutex> lock(m_tableMutex);
 
-        // Free the resources only if we are the last owner
-        if (*m_refCount == 0)
+    PageTable::const_iterator page = m_pages.find(hasColorStrikes() ? StrikePage : characterSize);
+
+    return page != m_pages.end() ? page->second.id : 0;
+}
+
+
+////////////////////////////////////////////////////////////
+ColorFont::MemoryUsage ColorFont::getMemoryUsage() const
+{
+    // Rough size of a tree node holding a table entry: the entry, three links and the color
+    const std::size_t glyphNode = sizeof(GlyphTable::value_type) + 4 * sizeof(void*);
+    const std::size_t meshNode  = sizeof(MeshTable::value_type) + 4 * sizeof(void*);
+
+    std::shared_lock<std::shared_mutex> lock(m_tableMutex);
+
+    MemoryUsage usage;
+
+    for (PageTable::const_iterator it = m_pages.begin(); it != m_pages.end(); ++it)
+    {
+        const Page& page = it->second;
+        Vector2u size = page.size;
+
+        std::size_t bytes = static_cast<std::size_t>(size.x) * size.y * (page.alphaOnly ? 1 : 4);
+
+        // The strike page is mipmapped, its levels add up to a third of the base level
+        if (it->first == StrikePage && hasColorStrikes())
+            bytes += bytes / 3;
+
+        usage.pages++;
+        usage.textureBytes += bytes;
+        usage.glyphs       += page.glyphs.size();
+        usage.tableBytes   += sizeof(Page) + page.glyphs.size() * glyphNode + page.rows.capacity() * sizeof(Row);
+
+        for (std::vector<Upload>::const_iterator upload = page.uploads.begin(); upload != page.uploads.end(); ++upload)
+            usage.tableBytes += sizeof(Upload) + upload->pixels.capacity();
+    }
+
+    for (std::map<unsigned int, GlyphTable>::const_iterator it = m_strikeGlyphs.begin(); it != m_strikeGlyphs.end(); ++it)
+        usage.tableBytes += it->second.size() * glyphNode;
+
+    for (std::map<unsigned int, GlyphTable>::const_iterator it = m_metrics.begin(); it != m_metrics.end(); ++it)
+    {
+        usage.metrics    += it->second.size();
+        usage.tableBytes += it->second.size() * glyphNode;
+    }
+
+    for (std::map<unsigned int, MeshTable>::const_iterator it = m_meshes.begin(); it != m_meshes.end(); ++it)
+    {
+        for (MeshTable::const_iterator mesh = it->second.begin(); mesh != it->second.end(); ++mesh)
+            usage.meshBytes += mesh->second.capacity() * sizeof(Vector2f);
+
+        usage.tableBytes += it->second.size() * meshNode;
+    }
+
+    // Rough size of a hash table entry: the entry, the node link and the bucket
+    usage.tableBytes += m_indices.size() * (sizeof(IndexTable::value_type) + 2 * sizeof(void*));
+
+    for (std::map<unsigned int, KerningTable>::const_iterator it = m_kerning.begin(); it != m_kerning.end(); ++it)
+        usage.tableBytes += it->second.size() * (sizeof(KerningTable::value_type) + 2 * sizeof(void*));
+
+    return usage;
+}
+
+
+////////////////////////////////////////////////////////////
+RichTextStats ColorFont::getStats() const
+{
+    RichTextStats stats = m_stats.snapshot();
+
+    std::shared_lock<std::shared_mutex> lock(m_tableMutex);
+
+    for (PageTable::const_iterator it = m_pages.begin(); it != m_pages.end(); ++it)
+    {
+        const Page& page = it->second;
+        Vector2u size = page.size;
+
+        for (std::vector<Row>::const_iterator row = page.rows.begin(); row != page.rows.end(); ++row)
+            stats.AtlasUsedPixels += static_cast<Uint64>(row->width) * row->height;
+
+        stats.AtlasPixels += static_cast<Uint64>(size.x) * size.y;
+    }
+
+    return stats;
+}
+
+
+////////////////////////////////////////////////////////////
+void ColorFont::resetStats()
+{
+    m_stats.reset();
+}
+
+
+////////////////////////////////////////////////////////////
+void ColorFont::advanceFrame()
+{
+    m_frame.store(m_frame.load() + 1);
+}
+
+
+////////////////////////////////////////////////////////////
+std::size_t ColorFont::trim(unsigned int maxIdleFrames, std::size_t textureBudget)
+{
+    std::size_t released = 0;
+    std::size_t total    = getMemoryUsage().textureBytes;
+
+    std::unique_lock<std::shared_mutex> lock(m_tableMutex);
+
+    const Uint64 frame = m_frame.load();
+
+    auto pageBytes = [this](PageTable::const_iterator page)
+    {
+        Vector2u size = page->second.size;
+        std::size_t bytes = static_cast<std::size_t>(size.x) * size.y * (page->second.alphaOnly ? 1 : 4);
+        return page->first == StrikePage && hasColorStrikes() ? bytes + bytes / 3 : bytes;
+    };
+
+    auto release = [&](PageTable::iterator page)
+    {
+        std::size_t bytes = pageBytes(page);
+        released += bytes;
+        total    -= bytes;
+
+        // Scaled strike glyphs point into the strike page
+        if (page->first == StrikePage && hasColorStrikes())
+            m_strikeGlyphs.clear();
+
+        return m_pages.erase(page);
+    };
+
+    // Pages idle for too long
+    for (PageTable::iterator page = m_pages.begin(); page != m_pages.end();)
+    {
+        if (frame - page->second.lastUse.load() > maxIdleFrames && frame - page->second.lastUse.load() > 1)
+            page = release(page);
+        else
+            ++page;
+    }
+
+    // Then the least recently used ones, until the budget is met
+    while (total > textureBudget)
+    {
+        PageTable::iterator oldest = m_pages.end();
+        for (PageTable::iterator page = m_pages.begin(); page != m_pages.end(); ++page)
+        {
+            if (frame - page->second.lastUse.load() > 1 && (oldest == m_pages.end() || page->second.lastUse.load() < oldest->second.lastUse.load()))
+                oldest = page;
+        }
+
+        // Everything left is in use
+        if (oldest == m_pages.end())
+            break;
+
+        release(oldest);
+    }
+
+    // Meshes are copied into the text geometry, releasing them never invalidates anything
+    for (std::map<unsigned int, FrameStamp>::iterator use = m_meshUse.begin(); use != m_meshUse.end();)
+    {
+        if (frame - use->second.load() > maxIdleFrames)
+        {
+            m_meshes.erase(use->first);
+            use = m_meshUse.erase(use);
+        }
+        else
+        {
+            ++use;
+        }
+    }
+
+    return released;
+}
+
+
+////////////////////////////////////////////////////////////
+ColorFont& ColorFont::operator =(const ColorFont& right)
+{
+    ColorFont temp(right);
+
+    std::swap(m_library,     temp.m_library);
+    std::swap(m_face,        temp.m_face);
+    std::swap(m_streamRec,   temp.m_streamRec);
+    std::swap(m_stroker,     temp.m_stroker);
+    std::swap(m_refCount,    temp.m_refCount);
+    std::swap(m_faceMutex,   temp.m_faceMutex);
+    std::swap(m_isSmooth,    temp.m_isSmooth);
+    std::swap(m_info,        temp.m_info);
+    std::swap(m_pages,       temp.m_pages);
+    std::swap(m_strikeGlyphs, temp.m_strikeGlyphs);
+    std::swap(m_metrics,     temp.m_metrics);
+    std::swap(m_meshes,      temp.m_meshes);
+    std::swap(m_indices,     temp.m_indices);
+    std::swap(m_kerning,     temp.m_kerning);
+    std::swap(m_vectorThreshold, temp.m_vectorThreshold);
+    std::swap(m_meshUse,     temp.m_meshUse);
+    std::swap(m_nextPageId,  temp.m_nextPageId);
+    std::swap(m_frame,       temp.m_frame);
+    std::swap(m_stats,       temp.m_stats);
+    std::swap(m_sharedCache, temp.m_sharedCache);
+    std::swap(m_contentHash, temp.m_contentHash);
+
+    #ifdef SFML_SYSTEM_ANDROID
+        std::swap(m_stream, temp.m_stream);
+    #endif
+
+    return *this;
+}
+
+
+////////////////////////////////////////////////////////////
+void ColorFont::cleanup()
+{
+    // Check if we must destroy the FreeType pointers
+    if (m_refCount)
+    {
+        // Decrease the reference counter
+        (*m_refCount)--;
+
+        // Free the resources only if we are the last owner
+        if (*m_refCount == 0)
         {
             // Delete the reference counter
             delete m_refCount;
+            delete m_faceMutex;
 
             // Destroy the stroker
             if (m_stroker)
@@ -538,8 +1301,15 @@ void ColorFont::cleanup()
     m_stroker   = NULL;
     m_streamRec = NULL;
     m_refCount  = NULL;
+    m_faceMutex = NULL;
+    m_contentHash = 0;
     m_pages.clear();
-    std::vector<Uint8>().swap(m_pixelBuffer);
+    m_strikeGlyphs.clear();
+    m_metrics.clear();
+    m_meshes.clear();
+    m_indices.clear();
+    m_kerning.clear();
+    m_meshUse.clear();
 }
 
 
@@ -549,64 +1319,253 @@ ColorFont::Page& ColorFont::loadPage(unsigned int characterSize) const
     // TODO: Remove this method and use try_emplace instead when updating to C++17
     PageTable::iterator pageIterator = m_pages.find(characterSize);
     if (pageIterator == m_pages.end())
-        pageIterator = m_pages.insert(std::make_pair(characterSize, Page(m_isSmooth))).first;
+    {
+        pageIterator = m_pages.emplace(std::piecewise_construct, std::forward_as_tuple(characterSize), std::forward_as_tuple(hasAlphaPages())).first;
+        pageIterator->second.id = m_nextPageId++;
+    }
+
+    pageIterator->second.lastUse.store(m_frame.load());
 
     return pageIterator->second;
 }
 
-static sf::Image ScaleImage(const sf::Image &sourceImage, float scaleFactor) {
-    unsigned int originalWidth = sourceImage.getSize().x;
-    unsigned int originalHeight = sourceImage.getSize().y;
-    unsigned int newWidth = static_cast<unsigned int>(std::floor(originalWidth * scaleFactor));
-    unsigned int newHeight = static_cast<unsigned int>(std::floor(originalHeight * scaleFactor));
-    
-    sf::Image scaledImage;
-    scaledImage.create(newWidth, newHeight);
+////////////////////////////////////////////////////////////
+unsigned int ColorFont::getGlyphIndex(Uint32 codePoint) const
+{
+    FT_Face face = static_cast<FT_Face>(m_face);
+    if (!face)
+        return 0;
+
+    {
+        std::shared_lock<std::shared_mutex> lock(m_tableMutex);
+
+        IndexTable::const_iterator it = m_indices.find(codePoint);
+        if (it != m_indices.end())
+            return it->second;
+    }
+
+    unsigned int index;
+    {
+        std::unique_lock<std::recursive_mutex> faceLock = lockFace();
+        index = FT_Get_Char_Index(face, codePoint);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_tableMutex);
+    m_indices.emplace(codePoint, index);
+
+    return index;
+}
+
 
-    for (unsigned int y = 0; y < newHeight; ++y) {
-        for (unsigned int x = 0; x < newWidth; ++x) {
-            float gx = ((float)x / newWidth) * (originalWidth - 1);
-            float gy = ((float)y / newHeight) * (originalHeight - 1);
-            unsigned int gxi = static_cast<unsigned int>(gx);
-            unsigned int gyi = static_cast<unsigned int>(gy);
-            sf::Color c00 = sourceImage.getPixel(gxi, gyi);
-            sf::Color c10 = sourceImage.getPixel(gxi + 1 >= originalWidth ? gxi : gxi + 1, gyi);
-            sf::Color c01 = sourceImage.getPixel(gxi, gyi + 1 >= originalHeight ? gyi : gyi + 1);
-            sf::Color c11 = sourceImage.getPixel(gxi + 1 >= originalWidth ? gxi : gxi + 1,
-                                                 gyi + 1 >= originalHeight ? gyi : gyi + 1);
+////////////////////////////////////////////////////////////
+long ColorFont::getPairKerning(unsigned int first, unsigned int second, unsigned int characterSize) const
+{
+    Uint64 key = (static_cast<Uint64>(first) << 32) | second;
 
-            float dx = gx - gxi;
-            float dy = gy - gyi;
-            sf::Color result(
-                static_cast<sf::Uint8>((c00.r * (1 - dx) + c10.r * dx) * (1 - dy) + (c01.r * (1 - dx) + c11.r * dx) * dy),
-                static_cast<sf::Uint8>((c00.g * (1 - dx) + c10.g * dx) * (1 - dy) + (c01.g * (1 - dx) + c11.g * dx) * dy),
-                static_cast<sf::Uint8>((c00.b * (1 - dx) + c10.b * dx) * (1 - dy) + (c01.b * (1 - dx) + c11.b * dx) * dy),
-                static_cast<sf::Uint8>((c00.a * (1 - dx) + c10.a * dx) * (1 - dy) + (c01.a * (1 - dx) + c11.a * dx) * dy)
-            );
+    {
+        std::shared_lock<std::shared_mutex> lock(m_tableMutex);
 
-            scaledImage.setPixel(x, y, result);
+        std::map<unsigned int, KerningTable>::const_iterator table = m_kerning.find(characterSize);
+        if (table != m_kerning.end())
+        {
+            KerningTable::const_iterator it = table->second.find(key);
+            if (it != table->second.end())
+                return it->second;
         }
     }
 
-    return scaledImage;
+    FT_Vector kerning;
+    kerning.x = kerning.y = 0;
+    {
+        std::unique_lock<std::recursive_mutex> faceLock = lockFace();
+
+        FT_Face face = static_cast<FT_Face>(m_face);
+        if (!setCurrentSize(characterSize))
+            return 0;
+
+        RICH_TEXT_COUNT(m_stats, FreeTypeCalls, 1);
+        FT_Get_Kerning(face, first, second, FT_KERNING_UNFITTED, &kerning);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_tableMutex);
+    m_kerning[characterSize].emplace(key, kerning.x);
+
+    return kerning.x;
 }
 
+
 ////////////////////////////////////////////////////////////
-Glyph ColorFont::loadGlyph(Uint32 codePoint, unsigned int characterSize, bool bold, float outlineThickness) const
+bool ColorFont::hasAlphaPages() const
+{
+    // Only color fonts need RGBA pages, the others just store coverage
+    #ifndef SFML_OPENGL_ES
+    return !isColorEmojiFont();
+    #else
+    return false; // OpenGL ES can't read alpha pages back when they grow
+    #endif
+}
+
+
+////////////////////////////////////////////////////////////
+std::unique_lock<std::recursive_mutex> ColorFont::lockFace() const
+{
+    if (!m_faceMutex)
+        return std::unique_lock<std::recursive_mutex>();
+
+    return std::unique_lock<std::recursive_mutex>(*m_faceMutex);
+}
+
+
+////////////////////////////////////////////////////////////
+Glyph ColorFont::loadGlyphMetrics(unsigned int index, unsigned int characterSize, bool bold) const
 {
-    // The glyph to return
     Glyph glyph;
 
-    // First, transform our ugly void* to a FT_Face
     FT_Face face = static_cast<FT_Face>(m_face);
     if (!face)
         return glyph;
 
-    // Set the character size
-    int renderedSize = setCurrentSize(characterSize);
-    if (renderedSize == 0){
-        err() << "Can't set size for char: " << codePoint << '\n';
+    // Color strikes are measured at their native size, like their bitmaps are rasterized
+    unsigned int loadedSize = hasColorStrikes() ? getStrikeSize() : characterSize;
+    if (!setCurrentSize(loadedSize))
         return glyph;
+
+    // Use the same flags as loadGlyph, so that hinting gives identical metrics
+    // (FT_LOAD_RENDER is not set: the outline is loaded but never rasterized)
+    FT_Int32 flags = (FT_HAS_COLOR(face) ? FT_LOAD_COLOR : FT_LOAD_TARGET_NORMAL) | FT_LOAD_FORCE_AUTOHINT;
+    RICH_TEXT_COUNT(m_stats, FreeTypeCalls, 1);
+    if (FT_Load_Glyph(face, index, flags) != 0)
+        return glyph;
+
+    FT_GlyphSlot slot = face->glyph;
+    FT_Pos weight = 1 << 6;
+
+    glyph.advance  = static_cast<float>(slot->advance.x >> 6);
+    glyph.lsbDelta = static_cast<int>(slot->lsb_delta);
+    glyph.rsbDelta = static_cast<int>(slot->rsb_delta);
+
+    if (bold)
+        glyph.advance += static_cast<float>(weight) / static_cast<float>(1 << 6);
+
+    if (slot->format == FT_GLYPH_FORMAT_OUTLINE)
+    {
+        if (bold)
+            FT_Outline_Embolden(&slot->outline, weight);
+
+        // Snap the control box to the pixel grid, the way the rasterizer sizes its bitmap
+        FT_BBox box;
+        FT_Outline_Get_CBox(&slot->outline, &box);
+
+        FT_Pos left   = box.xMin & ~63;
+        FT_Pos bottom = box.yMin & ~63;
+        FT_Pos right  = (box.xMax + 63) & ~63;
+        FT_Pos top    = (box.yMax + 63) & ~63;
+
+        if (right > left && top > bottom)
+        {
+            glyph.bounds.left   = static_cast<float>( left >> 6);
+            glyph.bounds.top    = static_cast<float>(-top >> 6);
+            glyph.bounds.width  = static_cast<float>((right - left) >> 6);
+            glyph.bounds.height = static_cast<float>((top - bottom) >> 6);
+        }
+    }
+    else if (slot->format == FT_GLYPH_FORMAT_BITMAP && slot->bitmap.width > 0 && slot->bitmap.rows > 0)
+    {
+        // Embedded bitmaps are loaded as-is, emboldening them grows them by one pixel
+        unsigned int extra = bold ? 1 : 0;
+
+        glyph.bounds.left   = static_cast<float>( slot->bitmap_left);
+        glyph.bounds.top    = static_cast<float>(-slot->bitmap_top);
+        glyph.bounds.width  = static_cast<float>( slot->bitmap.width + extra);
+        glyph.bounds.height = static_cast<float>( slot->bitmap.rows + extra);
+    }
+
+    if (loadedSize != characterSize)
+    {
+        float scale = static_cast<float>(characterSize) / static_cast<float>(loadedSize);
+
+        glyph.advance       *= scale;
+        glyph.lsbDelta       = static_cast<int>(static_cast<float>(glyph.lsbDelta) * scale);
+        glyph.rsbDelta       = static_cast<int>(static_cast<float>(glyph.rsbDelta) * scale);
+        glyph.bounds.left   *= scale;
+        glyph.bounds.top    *= scale;
+        glyph.bounds.width  *= scale;
+        glyph.bounds.height *= scale;
+    }
+
+    return glyph;
+}
+
+
+////////////////////////////////////////////////////////////
+std::vector<Vector2f> ColorFont::loadGlyphMesh(unsigned int index, unsigned int characterSize, bool bold, float outlineThickness) const
+{
+    FT_Face face = static_cast<FT_Face>(m_face);
+    if (!face || !setCurrentSize(characterSize))
+        return std::vector<Vector2f>();
+
+    // Same flags as the metrics, so that the mesh matches the advance and bounds used for layout
+    RICH_TEXT_COUNT(m_stats, FreeTypeCalls, 1);
+    if (FT_Load_Glyph(face, index, FT_LOAD_TARGET_NORMAL | FT_LOAD_FORCE_AUTOHINT) != 0)
+        return std::vector<Vector2f>();
+
+    FT_Glyph glyphDesc;
+    if (FT_Get_Glyph(face->glyph, &glyphDesc) != 0)
+        return std::vector<Vector2f>();
+
+    if (glyphDesc->format != FT_GLYPH_FORMAT_OUTLINE)
+    {
+        FT_Done_Glyph(glyphDesc);
+        return std::vector<Vector2f>();
+    }
+
+    if (bold)
+        FT_Outline_Embolden(&reinterpret_cast<FT_OutlineGlyph>(glyphDesc)->outline, 1 << 6);
+
+    if (outlineThickness != 0)
+    {
+        FT_Stroker stroker = static_cast<FT_Stroker>(m_stroker);
+
+        FT_Stroker_Set(stroker, static_cast<FT_Fixed>(outlineThickness * static_cast<float>(1 << 6)), FT_STROKER_LINECAP_ROUND, FT_STROKER_LINEJOIN_ROUND, 0);
+        FT_Glyph_Stroke(&glyphDesc, stroker, true);
+        RICH_TEXT_COUNT(m_stats, FreeTypeCalls, 1);
+    }
+
+    FT_Outline& outline = reinterpret_cast<FT_OutlineGlyph>(glyphDesc)->outline;
+
+    FT_Outline_Funcs funcs;
+    funcs.move_to  = &OutlineFlattener::moveTo;
+    funcs.line_to  = &OutlineFlattener::lineTo;
+    funcs.conic_to = &OutlineFlattener::conicTo;
+    funcs.cubic_to = &OutlineFlattener::cubicTo;
+    funcs.shift    = 0;
+    funcs.delta    = 0;
+
+    OutlineFlattener flattener;
+    FT_Outline_Decompose(&outline, &funcs, &flattener);
+    RICH_TEXT_COUNT(m_stats, FreeTypeCalls, 1);
+
+    bool evenOdd = (outline.flags & FT_OUTLINE_EVEN_ODD_FILL) != 0;
+
+    FT_Done_Glyph(glyphDesc);
+
+    return tessellate(flattener.contours, evenOdd);
+}
+
+
+////////////////////////////////////////////////////////////
+bool ColorFont::renderGlyph(Uint32 codePoint, unsigned int characterSize, bool bold, float outlineThickness, unsigned int padding, unsigned int channels, Glyph& glyph, std::vector<Uint8>& pixelBuffer) const
+{
+    // First, transform our ugly void* to a FT_Face
+    FT_Face face = static_cast<FT_Face>(m_face);
+    if (!face)
+        return false;
+
+    // Set the character size (color strikes are requested at their exact
+    // native size, so glyphs are always rasterized without any rescaling)
+    if (!setCurrentSize(characterSize)){
+        err() << "Can't set size for char: " << codePoint << '\n';
+        return false;
     }
 
     // Load the glyph corresponding to the code point
@@ -614,16 +1573,17 @@ Glyph ColorFont::loadGlyph(Uint32 codePoint, unsigned int characterSize, bool bo
 
     if (outlineThickness != 0)
         flags |= FT_LOAD_NO_BITMAP;
+    RICH_TEXT_COUNT(m_stats, FreeTypeCalls, 1);
     if (FT_Load_Char(face, codePoint, flags) != 0){
         err() << "Can't load char: " << codePoint << std::endl;
-        return glyph;
+        return false;
     }
 
     // Retrieve the glyph
     FT_Glyph glyphDesc;
     if (FT_Get_Glyph(face->glyph, &glyphDesc) != 0){
         err() << "Can't get glyph for char: " << codePoint << std::endl;
-        return glyph;
+        return false;
     }
 
     // Apply bold and outline (there is no fallback for outline) if necessary -- first technique using outline (highest quality)
@@ -643,6 +1603,7 @@ Glyph ColorFont::loadGlyph(Uint32 codePoint, unsigned int characterSize, bool bo
 
             FT_Stroker_Set(stroker, static_cast<FT_Fixed>(outlineThickness * static_cast<float>(1 << 6)), FT_STROKER_LINECAP_ROUND, FT_STROKER_LINEJOIN_ROUND, 0);
             FT_Glyph_Stroke(&glyphDesc, stroker, true);
+            RICH_TEXT_COUNT(m_stats, FreeTypeCalls, 1);
         }
     }
 
@@ -650,11 +1611,12 @@ Glyph ColorFont::loadGlyph(Uint32 codePoint, unsigned int characterSize, bool bo
     // Warning! After this line, do not read any data from glyphDesc directly, use
     // bitmapGlyph.root to access the FT_Glyph data.
     auto ft_err = FT_Glyph_To_Bitmap(&glyphDesc, FT_RENDER_MODE_NORMAL, 0, 1);
+    RICH_TEXT_COUNT(m_stats, FreeTypeCalls, 1);
 
     if(ft_err){
         err() << "Can't convert glyph to bitmap for char: " << codePoint << std::endl;
         err() << "Code: " << FT_Error_String(ft_err) << std::endl;
-        return glyph;
+        return false;
     }
 
     FT_BitmapGlyph bitmapGlyph = reinterpret_cast<FT_BitmapGlyph>(glyphDesc);
@@ -670,62 +1632,53 @@ Glyph ColorFont::loadGlyph(Uint32 codePoint, unsigned int characterSize, bool bo
             err() << "Failed to outline glyph (no fallback available)" << std::endl;
     }
 
-    auto scaleFactor = characterSize / float(renderedSize);
-
     // Compute the glyph's advance offset
     glyph.advance = static_cast<float>(bitmapGlyph->root.advance.x >> 16);
     if (bold)
         glyph.advance += static_cast<float>(weight) / static_cast<float>(1 << 6);
 
-    glyph.advance *= scaleFactor;
+    glyph.lsbDelta = static_cast<int>(face->glyph->lsb_delta);
+    glyph.rsbDelta = static_cast<int>(face->glyph->rsb_delta);
 
-    glyph.lsbDelta = static_cast<int>(face->glyph->lsb_delta) * scaleFactor;
-    glyph.rsbDelta = static_cast<int>(face->glyph->rsb_delta) * scaleFactor;
-
-
-    unsigned int width  = bitmap.width * scaleFactor;
-    unsigned int height = bitmap.rows * scaleFactor;
+    unsigned int width  = bitmap.width;
+    unsigned int height = bitmap.rows;
 
     if ((width > 0) && (height > 0))
     {
-        // Leave a small padding around characters, so that filtering doesn't
-        // pollute them with pixels from neighbors
-        const unsigned int padding = 2;
-
-        width += 2 * padding;
-        height += 2 * padding;
-
-        // Get the glyphs page corresponding to the character size
-        Page& page = loadPage(characterSize);
+        // Compute the glyph's bounding box
+        glyph.bounds.left   = static_cast<float>( bitmapGlyph->left);
+        glyph.bounds.top    = static_cast<float>(-bitmapGlyph->top);
+        glyph.bounds.width  = static_cast<float>( bitmap.width);
+        glyph.bounds.height = static_cast<float>( bitmap.rows);
 
-        // Find a good position for the new glyph into the texture
-        glyph.textureRect = findGlyphRect(page, width, height);
+        // The pixels go in the middle of the buffer, surrounded by the padding
+        glyph.textureRect = IntRect(static_cast<int>(padding), static_cast<int>(padding), static_cast<int>(width), static_cast<int>(height));
 
-        // Make sure the texture data is positioned in the center
-        // of the allocated texture rectangle
-        glyph.textureRect.left   += static_cast<int>(padding);
-        glyph.textureRect.top    += static_cast<int>(padding);
-        glyph.textureRect.width  -= static_cast<int>(2 * padding);
-        glyph.textureRect.height -= static_cast<int>(2 * padding);
+        width  += 2 * padding;
+        height += 2 * padding;
 
-        // Compute the glyph's bounding box
-        glyph.bounds.left   = static_cast<float>( bitmapGlyph->left * scaleFactor);
-        glyph.bounds.top    = static_cast<float>(-bitmapGlyph->top * scaleFactor);
-        glyph.bounds.width  = static_cast<float>( bitmap.width * scaleFactor);
-        glyph.bounds.height = static_cast<float>( bitmap.rows * scaleFactor);
+        // Alpha pages store a single coverage byte per pixel
+        const unsigned int alpha = channels - 1;
 
         // Resize the pixel buffer to the new size and fill it with transparent white pixels
-        m_pixelBuffer.resize(width * height * 4);
+        pixelBuffer.resize(width * height * channels);
 
-        Uint8* current = &m_pixelBuffer[0];
-        Uint8* end = current + width * height * 4;
+        Uint8* current = &pixelBuffer[0];
+        Uint8* end = current + width * height * channels;
 
-        while (current != end)
+        if (channels == 1)
         {
-            (*current++) = 255;
-            (*current++) = 255;
-            (*current++) = 255;
-            (*current++) = 0;
+            std::fill(current, end, 0);
+        }
+        else
+        {
+            while (current != end)
+            {
+                (*current++) = 255;
+                (*current++) = 255;
+                (*current++) = 255;
+                (*current++) = 0;
+            }
         }
 
         // Extract the glyph's pixels from the bitmap
@@ -739,51 +1692,27 @@ Glyph ColorFont::loadGlyph(Uint32 codePoint, unsigned int characterSize, bool bo
                 {
                     // The color channels remain white, just fill the alpha channel
                     std::size_t index = x + y * width;
-                    m_pixelBuffer[index * 4 + 3] = ((pixels[(x - padding) / 8]) & (1 << (7 - ((x - padding) % 8)))) ? 255 : 0;
+                    pixelBuffer[index * channels + alpha] = ((pixels[(x - padding) / 8]) & (1 << (7 - ((x - padding) % 8)))) ? 255 : 0;
                 }
                 pixels += bitmap.pitch;
             }
         }
         else if (bitmap.pixel_mode == FT_PIXEL_MODE_BGRA) 
         {
-            sf::Image emoji;
-            emoji.create(bitmap.width, bitmap.rows);
-
-            for (unsigned int y = 0; y < bitmap.rows; ++y)
+            // Pixels are premultiplied BGRA, strike glyphs are stored at their native size
+            for (unsigned int y = padding; y < height - padding; ++y)
             {
-                for (unsigned int x = 0; x < bitmap.width; ++x)
+                for (unsigned int x = padding; x < width - padding; ++x)
                 {
-                    // The color channels remain white, just fill the alpha channel
-                    std::size_t sourceIndex = (x) * 4;
-                    std::size_t index = x + y * bitmap.width;
-
-                    emoji.setPixel(x, y, {
-                        pixels[sourceIndex + 2],
-                        pixels[sourceIndex + 1],
-                        pixels[sourceIndex + 0],
-                        pixels[sourceIndex + 3]
-                    });
-                }
-
-                pixels += bitmap.pitch;
-            }
-
-            if(renderedSize != characterSize)
-                emoji = ScaleImage(emoji, scaleFactor);
+                    std::size_t sourceIndex = (x - padding) * 4;
+                    std::size_t index = x + y * width;
 
-            for (unsigned int y = 0; y < emoji.getSize().y; ++y)
-            {
-                for (unsigned int x = 0; x < emoji.getSize().x; ++x)
-                {
-                    auto pixel = emoji.getPixel(x, y);
-
-                    auto index = (padding + y) * width + padding + x;
-                    
-                    m_pixelBuffer[index * 4 + 0] = pixel.r;
-                    m_pixelBuffer[index * 4 + 1] = pixel.g;
-                    m_pixelBuffer[index * 4 + 2] = pixel.b;
-                    m_pixelBuffer[index * 4 + 3] = pixel.a;
+                    pixelBuffer[index * 4 + 0] = pixels[sourceIndex + 2];
+                    pixelBuffer[index * 4 + 1] = pixels[sourceIndex + 1];
+                    pixelBuffer[index * 4 + 2] = pixels[sourceIndex + 0];
+                    pixelBuffer[index * 4 + 3] = pixels[sourceIndex + 3];
                 }
+                pixels += bitmap.pitch;
             }
         }
         else
@@ -795,24 +1724,225 @@ Glyph ColorFont::loadGlyph(Uint32 codePoint, unsigned int characterSize, bool bo
                 {
                     // The color channels remain white, just fill the alpha channel
                     std::size_t index = x + y * width;
-                    m_pixelBuffer[index * 4 + 3] = pixels[x - padding];
+                    pixelBuffer[index * channels + alpha] = pixels[x - padding];
                 }
                 pixels += bitmap.pitch;
             }
         }
-
-        // Write the pixels to the texture
-        unsigned int x = static_cast<unsigned int>(glyph.textureRect.left) - padding;
-        unsigned int y = static_cast<unsigned int>(glyph.textureRect.top) - padding;
-        unsigned int w = static_cast<unsigned int>(glyph.textureRect.width) + 2 * padding;
-        unsigned int h = static_cast<unsigned int>(glyph.textureRect.height) + 2 * padding;
-        page.texture.update(&m_pixelBuffer[0], w, h, x, y);
     }
 
     // Delete the FT glyph
     FT_Done_Glyph(glyphDesc);
 
-    // Done :)
+    return true;
+}
+
+
+////////////////////////////////////////////////////////////
+const Glyph& ColorFont::loadGlyph(Uint32 codePoint, unsigned int characterSize, bool bold, float outlineThickness, Uint64 key) const
+{
+    RICH_TEXT_TIME(m_stats, GlyphLoadTime);
+    RICH_TEXT_TRACE_ZONE_ARG("ColorFont::loadGlyph", "codepoint", codePoint);
+
+    // The glyph to return
+    Glyph glyph;
+
+    // Leave a small padding around characters, so that filtering doesn't
+    // pollute them with pixels from neighbors (the strike page needs a wider
+    // one, as its lower mipmap levels average several texels together)
+    const bool strike = hasColorStrikes();
+    const unsigned int padding = strike ? StrikePadding : 2;
+    const unsigned int channels = hasAlphaPages() ? 1 : 4;
+
+    // Each thread rasterizes into its own buffer, without holding the tables
+    thread_local std::vector<Uint8> pixelBuffer;
+
+    // An other process may have rasterized it already, its bitmap is laid out exactly like renderGlyph does
+    SharedGlyphCache::Key sharedKey;
+    sharedKey.Font          = m_contentHash;
+    sharedKey.Glyph         = key;
+    sharedKey.CharacterSize = characterSize;
+    sharedKey.Format        = channels | (padding << 8);
+
+    const bool shared = m_sharedCache && m_contentHash;
+
+    bool rendered = false;
+    if (shared && m_sharedCache->find(sharedKey, glyph, pixelBuffer))
+    {
+        unsigned int width  = static_cast<unsigned int>(std::max(glyph.textureRect.width, 0)) + 2 * padding;
+        unsigned int height = static_cast<unsigned int>(std::max(glyph.textureRect.height, 0)) + 2 * padding;
+        bool empty = glyph.textureRect.width <= 0 || glyph.textureRect.height <= 0;
+
+        rendered = empty || pixelBuffer.size() >= static_cast<std::size_t>(width) * height * channels;
+
+        if (rendered)
+            RICH_TEXT_COUNT(m_stats, SharedCacheHits, 1);
+    }
+
+    if (!rendered)
+    {
+        {
+            std::unique_lock<std::recursive_mutex> faceLock = lockFace();
+            rendered = renderGlyph(codePoint, characterSize, bold, outlineThickness, padding, channels, glyph, pixelBuffer);
+        }
+
+        if (rendered && shared)
+        {
+            std::size_t size = 0;
+            if ((glyph.textureRect.width > 0) && (glyph.textureRect.height > 0))
+                size = static_cast<std::size_t>(glyph.textureRect.width + 2 * padding) * (glyph.textureRect.height + 2 * padding) * channels;
+
+            if (m_sharedCache->publish(sharedKey, glyph, pixelBuffer.data(), size))
+                RICH_TEXT_COUNT(m_stats, SharedCachePublishes, 1);
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_tableMutex);
+
+    // Get the glyphs page corresponding to the character size
+    Page& page = loadPage(strike ? StrikePage : characterSize);
+
+    // An other thread may have loaded the same glyph meanwhile
+    GlyphTable::const_iterator it = page.glyphs.find(key);
+    if (it != page.glyphs.end())
+        return it->second;
+
+    if (!rendered)
+        return page.glyphs.insert(std::make_pair(key, Glyph())).first->second;
+
+    if ((glyph.textureRect.width > 0) && (glyph.textureRect.height > 0))
+    {
+        unsigned int width  = static_cast<unsigned int>(glyph.textureRect.width) + 2 * padding;
+        unsigned int height = static_cast<unsigned int>(glyph.textureRect.height) + 2 * padding;
+
+        // Find a good position for the new glyph into the texture
+        IntRect rect = findGlyphRect(page, width, height);
+
+        // Make sure the texture data is positioned in the center
+        // of the allocated texture rectangle
+        glyph.textureRect.left += rect.left;
+        glyph.textureRect.top  += rect.top;
+
+        // The pixels wait in the page until the render thread asks for its texture
+        Upload upload;
+        upload.x      = static_cast<unsigned int>(rect.left);
+        upload.y      = static_cast<unsigned int>(rect.top);
+        upload.width  = width;
+        upload.height = height;
+        upload.pixels.assign(pixelBuffer.begin(), pixelBuffer.begin() + width * height * channels);
+
+        page.uploads.push_back(std::move(upload));
+    }
+
+    return page.glyphs.insert(std::make_pair(key, glyph)).first->second;
+}
+
+
+////////////////////////////////////////////////////////////
+void ColorFont::flushPage(Page& page, bool strike) const
+{
+    // Only the render thread gets here, it tells the other ones how far pages can grow
+    maximumTextureSize.store(Texture::getMaximumSize(), std::memory_order_relaxed);
+
+    Vector2u current = page.texture.getSize();
+
+    if (current.x == 0 || current.y == 0)
+    {
+        if (page.alphaOnly)
+        {
+            // Make sure that the texture is initialized by default, with
+            // a fully opaque 2x2 square reserved for texturing underlines
+            std::vector<Uint8> pixels(page.size.x * page.size.y, 0);
+            pixels[0] = pixels[1] = pixels[page.size.x] = pixels[page.size.x + 1] = 255;
+
+            page.texture.create(page.size.x, page.size.y);
+            AlphaTexture().create(page.texture, &pixels[0]);
+        }
+        else
+        {
+            // Make sure that the texture is initialized by default
+            sf::Image image;
+            image.create(page.size.x, page.size.y, Color(255, 255, 255, 0));
+
+            // Reserve a 2x2 white square for texturing underlines
+            for (unsigned int x = 0; x < 2; ++x)
+                for (unsigned int y = 0; y < 2; ++y)
+                    image.setPixel(x, y, Color(255, 255, 255, 255));
+
+            page.texture.loadFromImage(image);
+        }
+
+        page.texture.setSmooth(m_isSmooth);
+    }
+    else if (current != page.size)
+    {
+        RICH_TEXT_TRACE_ZONE_ARG("ColorFont::growTexture", "width", page.size.x);
+
+        // The page grew since the last flush, the texture is enlarged to match
+        Texture newTexture;
+        newTexture.create(page.size.x, page.size.y);
+        newTexture.setSmooth(m_isSmooth);
+        if (page.alphaOnly)
+            AlphaTexture().copy(page.texture, newTexture);
+        else
+            newTexture.update(page.texture);
+        page.texture.swap(newTexture);
+    }
+
+    for (std::vector<Upload>::const_iterator upload = page.uploads.begin(); upload != page.uploads.end(); ++upload)
+    {
+        RICH_TEXT_TRACE_ZONE_ARG("ColorFont::upload", "bytes", upload->pixels.size());
+
+        if (page.alphaOnly)
+            AlphaTexture().update(page.texture, &upload->pixels[0], upload->width, upload->height, upload->x, upload->y);
+        else
+            page.texture.update(&upload->pixels[0], upload->width, upload->height, upload->x, upload->y);
+
+        RICH_TEXT_COUNT(m_stats, TextureUploadBytes, upload->pixels.size());
+    }
+
+    if (strike && !page.uploads.empty())
+        page.mipmapOutdated = true;
+
+    page.uploads.clear();
+
+    if (page.mipmapOutdated)
+    {
+        page.texture.generateMipmap();
+        MipmapRange().limit(page.texture, StrikeMaxLevel);
+        page.mipmapOutdated = false;
+    }
+}
+
+
+////////////////////////////////////////////////////////////
+Glyph ColorFont::rasterizeGlyph(Uint32 codePoint, unsigned int characterSize, bool bold, std::vector<Uint8>& pixels) const
+{
+    Glyph glyph;
+
+    // Color strikes only exist at their native size, the metrics are scaled like getStrikeGlyph does
+    unsigned int loadedSize = hasColorStrikes() ? getStrikeSize() : characterSize;
+
+    {
+        std::unique_lock<std::recursive_mutex> faceLock = lockFace();
+
+        if (!renderGlyph(codePoint, loadedSize, bold, 0, 0, 4, glyph, pixels))
+            return Glyph();
+    }
+
+    if (loadedSize != characterSize)
+    {
+        float scale = static_cast<float>(characterSize) / static_cast<float>(loadedSize);
+
+        glyph.advance       *= scale;
+        glyph.lsbDelta       = static_cast<int>(static_cast<float>(glyph.lsbDelta) * scale);
+        glyph.rsbDelta       = static_cast<int>(static_cast<float>(glyph.rsbDelta) * scale);
+        glyph.bounds.left   *= scale;
+        glyph.bounds.top    *= scale;
+        glyph.bounds.width  *= scale;
+        glyph.bounds.height *= scale;
+    }
+
     return glyph;
 }
 
@@ -820,6 +1950,8 @@ Glyph ColorFont::loadGlyph(Uint32 codePoint, unsigned int characterSize, bool bo
 ////////////////////////////////////////////////////////////
 IntRect ColorFont::findGlyphRect(Page& page, unsigned int width, unsigned int height) const
 {
+    RICH_TEXT_TRACE_ZONE_ARG("ColorFont::findGlyphRect", "height", height);
+
     // Find the line that fits well the glyph
     Row* row = NULL;
     float bestRatio = 0;
@@ -832,7 +1964,7 @@ IntRect ColorFont::findGlyphRect(Page& page, unsigned int width, unsigned int he
             continue;
 
         // Check if there's enough horizontal space left in the row
-        if (width > page.texture.getSize().x - it->width)
+        if (width > page.size.x - it->width)
             continue;
 
         // Make sure that this new row is the best found so far
@@ -848,19 +1980,17 @@ IntRect ColorFont::findGlyphRect(Page& page, unsigned int width, unsigned int he
     if (!row)
     {
         unsigned int rowHeight = height + height / 10;
-        while ((page.nextRow + rowHeight >= page.texture.getSize().y) || (width >= page.texture.getSize().x))
+        while ((page.nextRow + rowHeight >= page.size.y) || (width >= page.size.x))
         {
-            // Not enough space: resize the texture if possible
-            unsigned int textureWidth  = page.texture.getSize().x;
-            unsigned int textureHeight = page.texture.getSize().y;
-            if ((textureWidth * 2 <= Texture::getMaximumSize()) && (textureHeight * 2 <= Texture::getMaximumSize()))
+            // Not enough space: resize the page if possible, its texture follows when the page is flushed
+            unsigned int maximumSize = maximumTextureSize.load(std::memory_order_relaxed);
+            if ((page.size.x * 2 <= maximumSize) && (page.size.y * 2 <= maximumSize))
             {
-                // Make the texture 2 times bigger
-                Texture newTexture;
-                newTexture.create(textureWidth * 2, textureHeight * 2);
-                newTexture.setSmooth(m_isSmooth);
-                newTexture.update(page.texture);
-                page.texture.swap(newTexture);
+                // Make the page 2 times bigger
+                page.size.x *= 2;
+                page.size.y *= 2;
+
+                RICH_TEXT_COUNT(m_stats, AtlasGrowths, 1);
             }
             else
             {
@@ -872,6 +2002,7 @@ IntRect ColorFont::findGlyphRect(Page& page, unsigned int width, unsigned int he
 
         // We can now create the new row
         page.rows.push_back(Row(page.nextRow, rowHeight));
+        RICH_TEXT_COUNT(m_stats, AtlasRows, 1);
         page.nextRow += rowHeight;
         row = &page.rows.back();
     }
@@ -900,19 +2031,21 @@ int ColorFont::setCurrentSize(unsigned int characterSize) const
     {
         if (FT_HAS_COLOR(face) && face->available_sizes) {
             int best_match = 0;
-            int diff = std::labs(characterSize - face->available_sizes[0].width);
+            int diff = std::abs(static_cast<int>(characterSize) - face->available_sizes[0].height);
             for (int i = 1; i < face->num_fixed_sizes; ++i) {
                 int ndiff =
-                std::labs(characterSize - face->available_sizes[i].width);
+                std::abs(static_cast<int>(characterSize) - face->available_sizes[i].height);
                 if (ndiff < diff) {
                     best_match = i;
                     diff = ndiff;
                 }
             }
+            RICH_TEXT_COUNT(m_stats, FreeTypeCalls, 1);
             FT_Error result = FT_Select_Size(face, best_match);
             return result == FT_Err_Ok ? face->available_sizes[best_match].height : 0;
         }
 
+        RICH_TEXT_COUNT(m_stats, FreeTypeCalls, 1);
         FT_Error result = FT_Set_Pixel_Sizes(face, 0, characterSize);
 
         if (result == FT_Err_Invalid_Pixel_Size)
@@ -941,19 +2074,40 @@ int ColorFont::setCurrentSize(unsigned int characterSize) const
     return characterSize;
 }
 
-ColorFont::Page::Page(bool smooth) :
-    nextRow(3)
+ColorFont::Page::Page(bool alpha) :
+    size(128, 128),
+    nextRow(3),
+    mipmapOutdated(false),
+    alphaOnly(alpha),
+    id(0),
+    lastUse(0)
 {
-    // Make sure that the texture is initialized by default
-    sf::Image image;
-    image.create(128, 128, Color(255, 255, 255, 0));
+    // The texture is created by the render thread, when the page is first flushed
+}
+
+ColorFont::Page::Page(const Page& copy) :
+    glyphs(copy.glyphs),
+    size(copy.size),
+    uploads(copy.uploads),
+    nextRow(copy.nextRow),
+    rows(copy.rows),
+    mipmapOutdated(copy.mipmapOutdated),
+    alphaOnly(copy.alphaOnly),
+    id(copy.id),
+    lastUse(copy.lastUse)
+{
+    if (!alphaOnly)
+    {
+        texture = copy.texture;
+        return;
+    }
 
-    // Reserve a 2x2 white square for texturing underlines
-    for (unsigned int x = 0; x < 2; ++x)
-        for (unsigned int y = 0; y < 2; ++y)
-            image.setPixel(x, y, Color(255, 255, 255, 255));
+    // Not flushed yet, the render thread creates the texture
+    if (copy.texture.getSize().x == 0)
+        return;
 
-    // Create the texture
-    texture.loadFromImage(image);
-    texture.setSmooth(smooth);
+    // sf::Texture would copy an alpha page into RGBA storage and lose its contents
+    texture.create(copy.texture.getSize().x, copy.texture.getSize().y);
+    texture.setSmooth(copy.texture.isSmooth());
+    AlphaTexture().copy(copy.texture, texture);
 }
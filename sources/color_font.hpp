@@ -2,11 +2,49 @@
 
 #include <SFML/Graphics/Font.hpp>
 #include <SFML/Graphics/Glyph.hpp>
-
+#include "rich_text_stats.hpp"
+#include "rich_text_trace.hpp"
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+class SharedGlyphCache;
+
+////////////////////////////////////////////////////////////
+/// \brief Font with color glyph support
+///
+/// Glyph, metrics, mesh, kerning and line metrics queries can
+/// be made from several threads at once. The glyph tables are
+/// read under a shared lock and only locked exclusively to
+/// insert, FreeType is entered by one thread at a time since
+/// the face and its stroker are shared, and rasterization uses
+/// a scratch buffer per thread. OpenGL is only touched by
+/// \ref getTexture, \ref setSmooth and \ref trim, which must
+/// be called from the render thread: glyphs loaded by other
+/// threads wait in CPU memory until their page is next asked
+/// for its texture. Loading, assigning and trimming a font
+/// must not overlap with any other use of it.
+///
+////////////////////////////////////////////////////////////
 class ColorFont
 {
 public:
 
+    ////////////////////////////////////////////////////////////
+    /// \brief Memory held by a font's caches
+    ///
+    ////////////////////////////////////////////////////////////
+    struct MemoryUsage
+    {
+        std::size_t pages        = 0; //!< Number of glyph pages, one texture each
+        std::size_t textureBytes = 0; //!< Video memory of the page textures, mipmaps included
+        std::size_t glyphs       = 0; //!< Number of rasterized glyphs
+        std::size_t metrics      = 0; //!< Number of glyphs in the metrics cache
+        std::size_t meshBytes    = 0; //!< Memory of the cached glyph meshes
+        std::size_t tableBytes   = 0; //!< Estimated overhead of the cache tables themselves
+    };
+
 public:
 
     ////////////////////////////////////////////////////////////
@@ -55,6 +93,21 @@ public:
     ////////////////////////////////////////////////////////////
     bool loadFromFile(const std::string& filename);
 
+    ////////////////////////////////////////////////////////////
+    /// \brief Load the font from a file whose content hash is known
+    ///
+    /// Same as loadFromFile, the hash keying the shared glyph
+    /// cache is taken as given instead of reading the whole file,
+    /// see FontFileStamp.
+    ///
+    /// \param filename    Path of the font file to load
+    /// \param contentHash Hash of the file content, 0 if unknown
+    ///
+    /// \return True if loading succeeded, false if it failed
+    ///
+    ////////////////////////////////////////////////////////////
+    bool loadFromFile(const std::string& filename, sf::Uint64 contentHash);
+
     ////////////////////////////////////////////////////////////
     /// \brief Load the font from a file in memory
     ///
@@ -130,6 +183,130 @@ public:
     ////////////////////////////////////////////////////////////
     const sf::Glyph& getGlyph(sf::Uint32 codePoint, unsigned int characterSize, bool bold, float outlineThickness = 0) const;
 
+    ////////////////////////////////////////////////////////////
+    /// \brief Retrieve the metrics of a glyph without rasterizing it
+    ///
+    /// The returned glyph has valid advance, bounds and hinting
+    /// deltas, but an empty texture rect: it is loaded without
+    /// being rendered, into a cache separate from the one of
+    /// \ref getGlyph, so measuring text never touches the textures.
+    ///
+    /// \param codePoint     Unicode code point of the character to get
+    /// \param characterSize Reference character size
+    /// \param bold          Retrieve the bold version or the regular one?
+    ///
+    /// \return The metrics of the glyph corresponding to \a codePoint and \a characterSize
+    ///
+    /// \see preloadGlyphMetrics
+    ///
+    ////////////////////////////////////////////////////////////
+    const sf::Glyph& getGlyphMetrics(sf::Uint32 codePoint, unsigned int characterSize, bool bold = false) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Fill the metrics cache for a whole set of code points
+    ///
+    /// Missing glyphs are loaded in a single pass, with the
+    /// character size selected only once. Code points already
+    /// in the cache are skipped.
+    ///
+    /// \param codePoints    Pointer to the code points to load
+    /// \param count         Number of code points
+    /// \param characterSize Reference character size
+    /// \param bold          Load the bold version or the regular one?
+    ///
+    /// \see getGlyphMetrics
+    ///
+    ////////////////////////////////////////////////////////////
+    void preloadGlyphMetrics(const sf::Uint32* codePoints, std::size_t count, unsigned int characterSize, bool bold = false) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Rasterize a glyph into a pixel buffer in CPU memory
+    ///
+    /// Unlike \ref getGlyph, nothing is cached and neither the
+    /// glyph pages nor OpenGL are involved, so it works on machines
+    /// without a GPU. The pixels are RGBA: white with the coverage
+    /// in alpha for regular glyphs, the glyph's own colors for
+    /// color glyphs. Color strikes are rasterized at their native
+    /// size, only the returned metrics are scaled.
+    ///
+    /// \param codePoint     Unicode code point of the character to rasterize
+    /// \param characterSize Reference character size
+    /// \param bold          Rasterize the bold version or the regular one?
+    /// \param pixels        Receives textureRect.width * textureRect.height pixels
+    ///
+    /// \return The glyph, its texture rect locates the pixels in \a pixels
+    ///
+    ////////////////////////////////////////////////////////////
+    sf::Glyph rasterizeGlyph(sf::Uint32 codePoint, unsigned int characterSize, bool bold, std::vector<sf::Uint8>& pixels) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Retrieve the outline of a glyph as a triangle mesh
+    ///
+    /// Used instead of \ref getGlyph for character sizes drawn
+    /// from vector paths (see \ref isVectorSize): the outline is
+    /// flattened and tessellated once, then cached, and never
+    /// enters a glyph page. Positions are relative to the pen
+    /// position on the baseline, three vertices per triangle.
+    /// Edges are not antialiased, smoothing comes from the
+    /// multisampling of the render target.
+    ///
+    /// \param codePoint        Unicode code point of the character to get
+    /// \param characterSize    Reference character size
+    /// \param bold             Retrieve the bold version or the regular one?
+    /// \param outlineThickness Thickness of outline (when != 0 the mesh covers the outline only)
+    ///
+    /// \return Triangles of the glyph, empty for glyphs without outline
+    ///
+    /// \see getGlyphMetrics
+    ///
+    ////////////////////////////////////////////////////////////
+    const std::vector<sf::Vector2f>& getGlyphMesh(sf::Uint32 codePoint, unsigned int characterSize, bool bold, float outlineThickness = 0) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Set the character size from which glyphs are drawn from vector paths
+    ///
+    /// Rasterizing very large glyphs would fill whole pages for
+    /// a few characters. The default threshold is 120 pixels.
+    /// Texts already laid out keep their geometry until they
+    /// are updated.
+    ///
+    /// \param characterSize Smallest character size drawn from vector paths
+    ///
+    /// \see isVectorSize
+    ///
+    ////////////////////////////////////////////////////////////
+    void setVectorThreshold(unsigned int characterSize);
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Tell whether glyphs of a character size are drawn from vector paths
+    ///
+    /// Only scalable fonts without color glyphs can be drawn
+    /// from vector paths, other fonts always use glyph pages.
+    ///
+    /// \param characterSize Reference character size
+    ///
+    /// \return True if \ref getGlyphMesh should be used for that size
+    ///
+    ////////////////////////////////////////////////////////////
+    bool isVectorSize(unsigned int characterSize) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Share rasterized glyphs with other processes
+    ///
+    /// Glyph bitmaps are looked up in the cache before asking
+    /// FreeType, and published to it after rasterizing them.
+    /// Only fonts loaded from a file or from memory take part,
+    /// the cache is keyed by a hash of their content. Hashing
+    /// reads all of the font data, so it is only done when
+    /// loading with a cache set: set the cache before loading,
+    /// or load with a known content hash. The cache must
+    /// outlive the font and its copies.
+    ///
+    /// \param cache Opened cache, or NULL to stop sharing
+    ///
+    ////////////////////////////////////////////////////////////
+    void setSharedGlyphCache(SharedGlyphCache* cache);
+
     ////////////////////////////////////////////////////////////
     /// \brief Determine if this font has a glyph representing the requested code point
     ///
@@ -148,6 +325,18 @@ public:
     ////////////////////////////////////////////////////////////
     bool hasGlyph(sf::Uint32 codePoint) const;
 
+    ////////////////////////////////////////////////////////////
+    /// \brief Get every code point the font has a glyph for
+    ///
+    /// Walks the whole character map of the face, which takes
+    /// a while for large CJK and emoji fonts: the result is
+    /// meant to be cached, see FontCoverage.
+    ///
+    /// \return Sorted, disjoint inclusive ranges of code points
+    ///
+    ////////////////////////////////////////////////////////////
+    std::vector<std::pair<sf::Uint32, sf::Uint32> > getCodePointRanges() const;
+
     ////////////////////////////////////////////////////////////
     /// \brief Get the kerning offset of two glyphs
     ///
@@ -215,6 +404,10 @@ public:
     /// are requested, thus it is not very relevant. It is mainly
     /// used internally by sf::Text.
     ///
+    /// Glyphs loaded since the last call, by any thread, are
+    /// written to the texture here: call it from the render
+    /// thread only.
+    ///
     /// \param characterSize Reference character size
     ///
     /// \return Texture containing the glyphs of the requested size
@@ -250,6 +443,83 @@ public:
 
     bool isColorEmojiFont()const;
 
+    ////////////////////////////////////////////////////////////
+    /// \brief Get the identifier of the glyph page of a character size
+    ///
+    /// Pages released by \ref trim get a new identifier when they
+    /// are created again, so geometry referencing a page can tell
+    /// that its texture rects are not valid anymore.
+    ///
+    /// \param characterSize Reference character size
+    ///
+    /// \return Identifier of the page, 0 if there is none
+    ///
+    ////////////////////////////////////////////////////////////
+    sf::Uint64 getPageId(unsigned int characterSize) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Report the memory held by the font's caches
+    ///
+    /// \return Page, glyph and table usage of the font
+    ///
+    ////////////////////////////////////////////////////////////
+    MemoryUsage getMemoryUsage() const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Get a snapshot of the font's performance counters
+    ///
+    /// Counters are only maintained when the library is built
+    /// with RICH_TEXT_STATS, they read zero otherwise. Every
+    /// value is also added to RichTextCounters::global(). The
+    /// atlas occupancy is measured on the current pages.
+    ///
+    /// \return Counters accumulated since the last reset
+    ///
+    /// \see resetStats
+    ///
+    ////////////////////////////////////////////////////////////
+    RichTextStats getStats() const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Reset the font's performance counters to zero
+    ///
+    /// \see getStats
+    ///
+    ////////////////////////////////////////////////////////////
+    void resetStats();
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Start a new frame for the trim policy
+    ///
+    /// Call it once per frame: a page counts as used during the
+    /// frame in which its texture or one of its glyphs was last
+    /// requested.
+    ///
+    /// \see trim
+    ///
+    ////////////////////////////////////////////////////////////
+    void advanceFrame();
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Release the pages and glyph meshes that are not used anymore
+    ///
+    /// Pages idle for more than \a maxIdleFrames frames are
+    /// released, then the least recently used ones until the
+    /// textures fit \a textureBudget. Pages used during the
+    /// current or the previous frame are always kept, so text
+    /// drawn every frame is never affected. ColorText notices
+    /// released pages and rebuilds its geometry when drawn again.
+    ///
+    /// \param maxIdleFrames Number of frames a page can stay unused
+    /// \param textureBudget Maximum video memory of the pages, in bytes
+    ///
+    /// \return Number of texture bytes released
+    ///
+    /// \see advanceFrame, getMemoryUsage
+    ///
+    ////////////////////////////////////////////////////////////
+    std::size_t trim(unsigned int maxIdleFrames, std::size_t textureBudget = static_cast<std::size_t>(-1));
+
     ////////////////////////////////////////////////////////////
     /// \brief Overload of assignment operator
     ///
@@ -280,18 +550,61 @@ private:
     ////////////////////////////////////////////////////////////
     typedef std::map<sf::Uint64, sf::Glyph> GlyphTable; //!< Table mapping a codepoint to its glyph
 
+    ////////////////////////////////////////////////////////////
+    /// \brief Frame number that concurrent lookups can update
+    ///
+    ////////////////////////////////////////////////////////////
+    struct FrameStamp
+    {
+        FrameStamp(sf::Uint64 frame = 0) : value(frame) {}
+
+        FrameStamp(const FrameStamp& copy) : value(copy.load()) {}
+
+        FrameStamp& operator =(const FrameStamp& right) { store(right.load()); return *this; }
+
+        sf::Uint64 load() const { return value.load(std::memory_order_relaxed); }
+
+        void store(sf::Uint64 frame) const { value.store(frame, std::memory_order_relaxed); }
+
+        mutable std::atomic<sf::Uint64> value; //!< Frame number, written by lookups holding a shared lock only
+    };
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Glyph pixels waiting to be written to a page texture
+    ///
+    ////////////////////////////////////////////////////////////
+    struct Upload
+    {
+        unsigned int           x;      //!< Left of the destination rectangle
+        unsigned int           y;      //!< Top of the destination rectangle
+        unsigned int           width;  //!< Width of the destination rectangle
+        unsigned int           height; //!< Height of the destination rectangle
+        std::vector<sf::Uint8> pixels; //!< Pixels in the page format
+    };
+
     ////////////////////////////////////////////////////////////
     /// \brief Structure defining a page of glyphs
     ///
     ////////////////////////////////////////////////////////////
     struct Page
     {
-        explicit Page(bool smooth);
+        explicit Page(bool alpha);
+
+        Page(const Page& copy);
+
+        // sf::Texture would go through copyToImage and lose an alpha page, only the constructor copies those
+        Page& operator =(const Page&) = delete;
 
         GlyphTable       glyphs;  //!< Table mapping code points to their corresponding glyph
-        sf::Texture          texture; //!< Texture containing the pixels of the glyphs
+        sf::Texture          texture; //!< Texture containing the pixels of the glyphs, only touched by the render thread
+        sf::Vector2u     size;    //!< Size of the page, the texture catches up with it when the page is flushed
+        std::vector<Upload> uploads; //!< Glyphs packed into the page but not written to the texture yet
         unsigned int     nextRow; //!< Y position of the next new row in the texture
         std::vector<Row> rows;    //!< List containing the position of all the existing rows
+        bool             mipmapOutdated; //!< Was the texture modified since its mipmaps were last generated?
+        bool             alphaOnly; //!< Does the texture store coverage only (GL_ALPHA8) instead of RGBA pixels?
+        sf::Uint64       id;      //!< Identifier, unique among the pages ever created by the font
+        FrameStamp       lastUse; //!< Frame in which the page was last used
     };
 
     ////////////////////////////////////////////////////////////
@@ -303,6 +616,8 @@ private:
     ////////////////////////////////////////////////////////////
     /// \brief Find or create the glyphs page corresponding to the given character size
     ///
+    /// Requires the table lock held exclusively.
+    ///
     /// \param characterSize Reference character size
     ///
     /// \return The glyphs page corresponding to \a characterSize
@@ -313,19 +628,161 @@ private:
     ////////////////////////////////////////////////////////////
     /// \brief Load a new glyph and store it in the cache
     ///
+    /// The glyph is rasterized without holding the tables, then
+    /// packed into its page and queued for upload. If an other
+    /// thread stored it meanwhile, that glyph is returned.
+    ///
     /// \param codePoint        Unicode code point of the character to load
     /// \param characterSize    Reference character size
     /// \param bold             Retrieve the bold version or the regular one?
     /// \param outlineThickness Thickness of outline (when != 0 the glyph will not be filled)
+    /// \param key              Key of the glyph in the page table
     ///
     /// \return The glyph corresponding to \a codePoint and \a characterSize
     ///
     ////////////////////////////////////////////////////////////
-    sf::Glyph loadGlyph(sf::Uint32 codePoint, unsigned int characterSize, bool bold, float outlineThickness) const;
+    const sf::Glyph& loadGlyph(sf::Uint32 codePoint, unsigned int characterSize, bool bold, float outlineThickness, sf::Uint64 key) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Write the pending glyphs of a page to its texture
+    ///
+    /// Creates or grows the texture first if needed. Requires the
+    /// table lock held exclusively, on the render thread.
+    ///
+    /// \param page   Page to flush
+    /// \param strike Is it the mipmapped strike page?
+    ///
+    ////////////////////////////////////////////////////////////
+    void flushPage(Page& page, bool strike) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Get the index of a character in the font face
+    ///
+    /// Indices are cached, so FreeType is only entered once per
+    /// code point.
+    ///
+    /// \param codePoint Unicode code point of the character
+    ///
+    /// \return Glyph index, 0 if the font has no such character
+    ///
+    ////////////////////////////////////////////////////////////
+    unsigned int getGlyphIndex(sf::Uint32 codePoint) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Get the kerning of a glyph pair from the face
+    ///
+    /// \param first         Index of the left glyph
+    /// \param second        Index of the right glyph
+    /// \param characterSize Reference character size
+    ///
+    /// \return Unfitted kerning, in 26.6 fixed point
+    ///
+    ////////////////////////////////////////////////////////////
+    long getPairKerning(unsigned int first, unsigned int second, unsigned int characterSize) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Tell whether the pages store coverage only
+    ///
+    /// \return True for alpha pages, false for RGBA ones
+    ///
+    ////////////////////////////////////////////////////////////
+    bool hasAlphaPages() const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Lock the FreeType face shared by the copies of the font
+    ///
+    /// \return Lock owning the face mutex, empty if no font is loaded
+    ///
+    ////////////////////////////////////////////////////////////
+    std::unique_lock<std::recursive_mutex> lockFace() const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Rasterize a glyph into a pixel buffer
+    ///
+    /// Requires the face lock.
+    ///
+    /// \param codePoint        Unicode code point of the character to render
+    /// \param characterSize    Character size to set on the face
+    /// \param bold             Render the bold version or the regular one?
+    /// \param outlineThickness Thickness of outline (when != 0 the glyph will not be filled)
+    /// \param padding          Transparent border left around the pixels, in pixels
+    /// \param channels         1 for coverage only, 4 for RGBA
+    /// \param glyph            Receives the metrics, the texture rect locates the pixels in the buffer
+    /// \param pixelBuffer      Receives the padded pixels
+    ///
+    /// \return True on success, false if any error happened
+    ///
+    ////////////////////////////////////////////////////////////
+    bool renderGlyph(sf::Uint32 codePoint, unsigned int characterSize, bool bold, float outlineThickness, unsigned int padding, unsigned int channels, sf::Glyph& glyph, std::vector<sf::Uint8>& pixelBuffer) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Load the metrics of a glyph, without rendering it
+    ///
+    /// Requires the face lock.
+    ///
+    /// \param index         Index of the glyph in the font face
+    /// \param characterSize Reference character size
+    /// \param bold          Load the bold version or the regular one?
+    ///
+    /// \return The glyph metrics, with an empty texture rect
+    ///
+    ////////////////////////////////////////////////////////////
+    sf::Glyph loadGlyphMetrics(unsigned int index, unsigned int characterSize, bool bold) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Load the outline of a glyph and tessellate it into triangles
+    ///
+    /// Requires the face lock.
+    ///
+    /// \param index            Index of the glyph in the font face
+    /// \param characterSize    Reference character size
+    /// \param bold             Load the bold version or the regular one?
+    /// \param outlineThickness Thickness of outline (when != 0 the mesh covers the outline only)
+    ///
+    /// \return Triangles of the glyph, empty for glyphs without outline
+    ///
+    ////////////////////////////////////////////////////////////
+    std::vector<sf::Vector2f> loadGlyphMesh(unsigned int index, unsigned int characterSize, bool bold, float outlineThickness) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Retrieve a glyph of a color bitmap font
+    ///
+    /// The glyph is rasterized only once, at the native strike size,
+    /// into the shared mipmapped strike page. Every requested size
+    /// reuses that bitmap, only the metrics are scaled.
+    ///
+    /// \param codePoint        Unicode code point of the character to get
+    /// \param characterSize    Reference character size
+    /// \param bold             Retrieve the bold version or the regular one?
+    /// \param outlineThickness Thickness of outline (when != 0 the glyph will not be filled)
+    ///
+    /// \return The glyph corresponding to \a codePoint, scaled to \a characterSize
+    ///
+    ////////////////////////////////////////////////////////////
+    const sf::Glyph& getStrikeGlyph(sf::Uint32 codePoint, unsigned int characterSize, bool bold, float outlineThickness) const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Tell whether the font is made of fixed size color bitmaps
+    ///
+    /// \return True if glyphs should go through the shared strike page
+    ///
+    ////////////////////////////////////////////////////////////
+    bool hasColorStrikes() const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Get the size of the largest color bitmap strike
+    ///
+    /// \return Height of the strike used to fill the strike page, in pixels
+    ///
+    ////////////////////////////////////////////////////////////
+    unsigned int getStrikeSize() const;
 
     ////////////////////////////////////////////////////////////
     /// \brief Find a suitable rectangle within the texture for a glyph
     ///
+    /// Only the page size grows, the texture follows when the
+    /// page is flushed. Requires the table lock held exclusively.
+    ///
     /// \param page   Page of glyphs to search in
     /// \param width  Width of the rectangle
     /// \param height Height of the rectangle
@@ -338,6 +795,8 @@ private:
     ////////////////////////////////////////////////////////////
     /// \brief Make sure that the given size is the current one
     ///
+    /// Requires the face lock.
+    ///
     /// \param characterSize Reference character size
     ///
     /// \return True on success, false if any error happened
@@ -349,6 +808,9 @@ private:
     // Types
     ////////////////////////////////////////////////////////////
     typedef std::map<unsigned int, Page> PageTable; //!< Table mapping a character size to its page (texture)
+    typedef std::map<sf::Uint64, std::vector<sf::Vector2f> > MeshTable; //!< Table mapping a glyph to its triangles
+    typedef std::unordered_map<sf::Uint32, unsigned int> IndexTable; //!< Table mapping a code point to its glyph index
+    typedef std::unordered_map<sf::Uint64, long> KerningTable; //!< Table mapping a pair of glyph indices to their kerning
 
     ////////////////////////////////////////////////////////////
     // Member data
@@ -358,10 +820,23 @@ private:
     void*                      m_streamRec;   //!< Pointer to the stream rec instance (it is typeless to avoid exposing implementation details)
     void*                      m_stroker;     //!< Pointer to the stroker (it is typeless to avoid exposing implementation details)
     int*                       m_refCount;    //!< Reference counter used by implicit sharing
+    std::recursive_mutex*      m_faceMutex;   //!< Serializes the use of the FreeType objects, shared like them
+    mutable std::shared_mutex  m_tableMutex;  //!< Guards the tables below, shared for lookups and exclusive for insertions
     bool                       m_isSmooth;    //!< Status of the smooth filter
     sf::Font::Info                       m_info;        //!< Information about the font
     mutable PageTable          m_pages;       //!< Table containing the glyphs pages by character size
-    mutable std::vector<sf::Uint8> m_pixelBuffer; //!< Pixel buffer holding a glyph's pixels before being written to the texture
+    mutable std::map<unsigned int, GlyphTable> m_strikeGlyphs; //!< Strike glyphs with metrics scaled to each requested character size
+    mutable std::map<unsigned int, GlyphTable> m_metrics;      //!< Glyph metrics by character size, never rasterized
+    mutable std::map<unsigned int, MeshTable>  m_meshes;       //!< Tessellated glyph outlines by character size
+    mutable IndexTable         m_indices;     //!< Glyph indices of the code points looked up so far
+    mutable std::map<unsigned int, KerningTable> m_kerning;    //!< Kerning of the glyph pairs looked up so far, by character size
+    unsigned int               m_vectorThreshold; //!< Smallest character size drawn from vector paths
+    mutable std::map<unsigned int, FrameStamp> m_meshUse;      //!< Frame in which the meshes of each character size were last used
+    mutable sf::Uint64         m_nextPageId;  //!< Identifier given to the next page created
+    FrameStamp                 m_frame;       //!< Current frame of the trim policy
+    mutable RichTextCounters   m_stats;       //!< Performance counters, summed into the global ones
+    SharedGlyphCache*          m_sharedCache; //!< Glyph bitmaps shared with other processes (NULL for none)
+    sf::Uint64                 m_contentHash; //!< Hash of the font data keying the shared cache (0 when unknown)
     #ifdef SFML_SYSTEM_ANDROID
     void*                      m_stream; //!< Asset file streamer (if loaded from file)
     #endif
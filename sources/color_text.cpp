@@ -1,16 +1,39 @@
 #include "color_text.hpp"
+#include "text_layout.hpp"
 
 #include <SFML/Graphics/Text.hpp>
 #include <SFML/Graphics/Texture.hpp>
 #include <SFML/Graphics/RenderTarget.hpp>
+#include <algorithm>
 #include <cmath>
 
 using namespace sf;
 
 namespace
 {
+    // Writes into a pre-sized slice of a vertex array, or only counts the vertices when there is no slice
+    struct VertexSlice
+    {
+        sf::Vertex* vertices;
+        std::size_t base;
+        std::size_t count;
+
+        void append(const sf::Vertex& vertex)
+        {
+            if (vertices)
+                vertices[count] = vertex;
+            ++count;
+        }
+
+        std::size_t getVertexCount() const
+        {
+            return base + count;
+        }
+    };
+
     // Add an underline or strikethrough line to the vertex array
-    void addLine(sf::VertexArray& vertices, float lineLength, float lineTop, const sf::Color& color, float offset, float thickness, float outlineThickness = 0)
+    template <typename Vertices>
+    void addLine(Vertices& vertices, float lineLength, float lineTop, const sf::Color& color, float offset, float thickness, float outlineThickness = 0)
     {
         float top = std::floor(lineTop + offset - (thickness / 2) + 0.5f);
         float bottom = top + std::floor(thickness + 0.5f);
@@ -23,8 +46,17 @@ namespace
         vertices.append(sf::Vertex(sf::Vector2f(lineLength + outlineThickness, bottom + outlineThickness), color, sf::Vector2f(1, 1)));
     }
 
+    // Add the triangles of a glyph drawn from its vector path, they are not textured
+    template <typename Vertices>
+    void addGlyphMesh(Vertices& vertices, sf::Vector2f position, const sf::Color& color, const std::vector<sf::Vector2f>& mesh, float italicShear)
+    {
+        for (std::size_t i = 0; i < mesh.size(); ++i)
+            vertices.append(sf::Vertex(sf::Vector2f(position.x + mesh[i].x - italicShear * mesh[i].y, position.y + mesh[i].y), color));
+    }
+
     // Add a glyph quad to the vertex array
-    void addGlyphQuad(sf::VertexArray& vertices, sf::Vector2f position, const sf::Color& color, const sf::Glyph& glyph, float italicShear)
+    template <typename Vertices>
+    void addGlyphQuad(Vertices& vertices, sf::Vector2f position, const sf::Color& color, const sf::Glyph& glyph, float italicShear)
     {
         float padding = 1.0;
 
@@ -33,10 +65,15 @@ namespace
         float right  = glyph.bounds.left + glyph.bounds.width + padding;
         float bottom = glyph.bounds.top  + glyph.bounds.height + padding;
 
-        float u1 = static_cast<float>(glyph.textureRect.left) - padding;
-        float v1 = static_cast<float>(glyph.textureRect.top) - padding;
-        float u2 = static_cast<float>(glyph.textureRect.left + glyph.textureRect.width) + padding;
-        float v2 = static_cast<float>(glyph.textureRect.top  + glyph.textureRect.height) + padding;
+        // Color strike glyphs are drawn scaled from their native bitmap,
+        // so the padding has to be converted into texels
+        float uPadding = glyph.bounds.width  > 0 ? padding * glyph.textureRect.width  / glyph.bounds.width  : padding;
+        float vPadding = glyph.bounds.height > 0 ? padding * glyph.textureRect.height / glyph.bounds.height : padding;
+
+        float u1 = static_cast<float>(glyph.textureRect.left) - uPadding;
+        float v1 = static_cast<float>(glyph.textureRect.top) - vPadding;
+        float u2 = static_cast<float>(glyph.textureRect.left + glyph.textureRect.width) + uPadding;
+        float v2 = static_cast<float>(glyph.textureRect.top  + glyph.textureRect.height) + vPadding;
 
         vertices.append(sf::Vertex(sf::Vector2f(position.x + left  - italicShear * top   , position.y + top),    color, sf::Vector2f(u1, v1)));
         vertices.append(sf::Vertex(sf::Vector2f(position.x + right - italicShear * top   , position.y + top),    color, sf::Vector2f(u2, v1)));
@@ -45,6 +82,333 @@ namespace
         vertices.append(sf::Vertex(sf::Vector2f(position.x + right - italicShear * top   , position.y + top),    color, sf::Vector2f(u2, v1)));
         vertices.append(sf::Vertex(sf::Vector2f(position.x + right - italicShear * bottom, position.y + bottom), color, sf::Vector2f(u2, v2)));
     }
+
+    // Everything the glyph loop reads, computed once per geometry update
+    struct GeometryStyle
+    {
+        const ColorFont* font;
+        unsigned int     characterSize;
+        bool             bold;
+        bool             underlined;
+        bool             strikeThrough;
+        bool             vectorGlyphs;
+        float            italicShear;
+        float            underlineOffset;
+        float            underlineThickness;
+        float            strikeThroughOffset;
+        float            whitespaceWidth;
+        float            letterSpacing;
+        float            lineSpacing;
+        float            outlineThickness;
+        sf::Color        fillColor;
+        sf::Color        outlineColor;
+    };
+
+    // Pen position and bounds carried from one character to the next
+    struct GeometryCursor
+    {
+        float      x;
+        float      y;
+        sf::Uint32 prevChar;
+        float      minX;
+        float      minY;
+        float      maxX;
+        float      maxY;
+    };
+
+    // Add the geometry of the characters [begin, end), the vertex tables are indexed by character of the whole string
+    template <typename Vertices>
+    void addGlyphs(const GeometryStyle& style, const sf::String& string, std::size_t begin, std::size_t end, GeometryCursor& cursor,
+                   Vertices& vertices, Vertices& outlineVertices, std::size_t* glyphVertices, std::size_t* glyphOutlineVertices)
+    {
+        const ColorFont& font = *style.font;
+        const sf::Color realFillColor = font.isColorEmojiFont() ? sf::Color::White : style.fillColor;
+
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            sf::Uint32 curChar = string[i];
+
+            // Vertices added from here to the next character belong to this one
+            if (glyphVertices)
+            {
+                glyphVertices[i]        = vertices.getVertexCount();
+                glyphOutlineVertices[i] = outlineVertices.getVertexCount();
+            }
+
+            // Skip the \r char to avoid weird graphical issues
+            if (curChar == L'\r')
+                continue;
+
+            // Apply the kerning offset
+            cursor.x += font.getKerning(cursor.prevChar, curChar, style.characterSize, style.bold);
+
+            // If we're using the underlined style and there's a new line, draw a line
+            if (style.underlined && (curChar == L'\n' && cursor.prevChar != L'\n'))
+            {
+                addLine(vertices, cursor.x, cursor.y, style.fillColor, style.underlineOffset, style.underlineThickness);
+
+                if (style.outlineThickness != 0)
+                    addLine(outlineVertices, cursor.x, cursor.y, style.outlineColor, style.underlineOffset, style.underlineThickness, style.outlineThickness);
+            }
+
+            // If we're using the strike through style and there's a new line, draw a line across all characters
+            if (style.strikeThrough && (curChar == L'\n' && cursor.prevChar != L'\n'))
+            {
+                addLine(vertices, cursor.x, cursor.y, style.fillColor, style.strikeThroughOffset, style.underlineThickness);
+
+                if (style.outlineThickness != 0)
+                    addLine(outlineVertices, cursor.x, cursor.y, style.outlineColor, style.strikeThroughOffset, style.underlineThickness, style.outlineThickness);
+            }
+
+            cursor.prevChar = curChar;
+
+            // Handle special characters
+            if ((curChar == L' ') || (curChar == L'\n') || (curChar == L'\t'))
+            {
+                // Update the current bounds (min coordinates)
+                cursor.minX = std::min(cursor.minX, cursor.x);
+                cursor.minY = std::min(cursor.minY, cursor.y);
+
+                switch (curChar)
+                {
+                    case L' ':  cursor.x += style.whitespaceWidth;           break;
+                    case L'\t': cursor.x += style.whitespaceWidth * 4;       break;
+                    case L'\n': cursor.y += style.lineSpacing; cursor.x = 0; break;
+                }
+
+                // Update the current bounds (max coordinates)
+                cursor.maxX = std::max(cursor.maxX, cursor.x);
+                cursor.maxY = std::max(cursor.maxY, cursor.y);
+
+                // Next glyph, no need to create a quad for whitespace
+                continue;
+            }
+
+            // Apply the outline
+            if (style.outlineThickness != 0)
+            {
+                if (style.vectorGlyphs)
+                {
+                    addGlyphMesh(outlineVertices, sf::Vector2f(cursor.x, cursor.y), style.outlineColor, font.getGlyphMesh(curChar, style.characterSize, style.bold, style.outlineThickness), style.italicShear);
+                }
+                else
+                {
+                    const sf::Glyph& glyph = font.getGlyph(curChar, style.characterSize, style.bold, style.outlineThickness);
+
+                    // Add the outline glyph to the vertices
+                    addGlyphQuad(outlineVertices, sf::Vector2f(cursor.x, cursor.y), style.outlineColor, glyph, style.italicShear);
+                }
+            }
+
+            // Extract the current glyph's description
+            const sf::Glyph& glyph = style.vectorGlyphs ? font.getGlyphMetrics(curChar, style.characterSize, style.bold) : font.getGlyph(curChar, style.characterSize, style.bold);
+
+            // Add the glyph to the vertices
+            if (style.vectorGlyphs)
+                addGlyphMesh(vertices, sf::Vector2f(cursor.x, cursor.y), realFillColor, font.getGlyphMesh(curChar, style.characterSize, style.bold), style.italicShear);
+            else
+                addGlyphQuad(vertices, sf::Vector2f(cursor.x, cursor.y), realFillColor, glyph, style.italicShear);
+
+            // Update the current bounds
+            float left   = glyph.bounds.left;
+            float top    = glyph.bounds.top;
+            float right  = glyph.bounds.left + glyph.bounds.width;
+            float bottom = glyph.bounds.top + glyph.bounds.height;
+
+            cursor.minX = std::min(cursor.minX, cursor.x + left - style.italicShear * bottom);
+            cursor.maxX = std::max(cursor.maxX, cursor.x + right - style.italicShear * top);
+            cursor.minY = std::min(cursor.minY, cursor.y + top);
+            cursor.maxY = std::max(cursor.maxY, cursor.y + bottom);
+
+            // Advance to the next character
+            cursor.x += glyph.advance + style.letterSpacing;
+        }
+    }
+
+    // Vertices of a glyph drawn from its vector path, and of its outline
+    struct GlyphVertexCount
+    {
+        sf::Uint32  character;
+        std::size_t fill;
+        std::size_t outline;
+    };
+
+    // Load every glyph and kerning pair the string uses, so the workers only ever hit the font's tables.
+    // Returns the mesh sizes of the glyphs for vector sizes, sorted by character
+    std::vector<GlyphVertexCount> loadGlyphs(const GeometryStyle& style, const sf::String& string, sf::Uint32 prevChar)
+    {
+        std::vector<sf::Uint32> characters(string.begin(), string.end());
+        std::sort(characters.begin(), characters.end());
+        characters.erase(std::unique(characters.begin(), characters.end()), characters.end());
+
+        std::vector<GlyphVertexCount> meshCounts;
+
+        for (std::size_t i = 0; i < characters.size(); ++i)
+        {
+            sf::Uint32 character = characters[i];
+            if ((character == L' ') || (character == L'\n') || (character == L'\t') || (character == L'\r'))
+                continue;
+
+            if (style.vectorGlyphs)
+            {
+                GlyphVertexCount count = {character, 0, 0};
+
+                style.font->getGlyphMetrics(character, style.characterSize, style.bold);
+                count.fill = style.font->getGlyphMesh(character, style.characterSize, style.bold).size();
+                if (style.outlineThickness != 0)
+                    count.outline = style.font->getGlyphMesh(character, style.characterSize, style.bold, style.outlineThickness).size();
+
+                meshCounts.push_back(count);
+            }
+            else
+            {
+                style.font->getGlyph(character, style.characterSize, style.bold);
+                if (style.outlineThickness != 0)
+                    style.font->getGlyph(character, style.characterSize, style.bold, style.outlineThickness);
+            }
+        }
+
+        // Pairs the way addGlyphs forms them, a miss there would take the face lock and the exclusive table lock
+        std::vector<sf::Uint64> pairs;
+        pairs.reserve(string.getSize());
+        for (std::size_t i = 0; i < string.getSize(); ++i)
+        {
+            if (string[i] == L'\r')
+                continue;
+
+            pairs.push_back(static_cast<sf::Uint64>(prevChar) << 32 | string[i]);
+            prevChar = string[i];
+        }
+        std::sort(pairs.begin(), pairs.end());
+        pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+        for (std::size_t i = 0; i < pairs.size(); ++i)
+            style.font->getKerning(static_cast<sf::Uint32>(pairs[i] >> 32), static_cast<sf::Uint32>(pairs[i]), style.characterSize, style.bold);
+
+        return meshCounts;
+    }
+
+    // Number of vertices addGlyphs adds for the characters [begin, end), without positioning anything
+    void countGlyphs(const GeometryStyle& style, const sf::String& string, std::size_t begin, std::size_t end, sf::Uint32 prevChar,
+                     const std::vector<GlyphVertexCount>& meshCounts, std::size_t& fill, std::size_t& outline)
+    {
+        const std::size_t lineVertices = (style.underlined ? 6 : 0) + (style.strikeThrough ? 6 : 0);
+        const bool        outlined     = style.outlineThickness != 0;
+
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            sf::Uint32 curChar = string[i];
+
+            if (curChar == L'\r')
+                continue;
+
+            if (curChar == L'\n' && prevChar != L'\n')
+            {
+                fill += lineVertices;
+                if (outlined)
+                    outline += lineVertices;
+            }
+
+            prevChar = curChar;
+
+            if ((curChar == L' ') || (curChar == L'\n') || (curChar == L'\t'))
+                continue;
+
+            if (style.vectorGlyphs)
+            {
+                std::vector<GlyphVertexCount>::const_iterator it = std::lower_bound(meshCounts.begin(), meshCounts.end(), curChar,
+                    [](const GlyphVertexCount& count, sf::Uint32 character) { return count.character < character; });
+
+                fill    += it->fill;
+                outline += it->outline;
+            }
+            else
+            {
+                fill += 6;
+                if (outlined)
+                    outline += 6;
+            }
+        }
+    }
+
+    // Same geometry as a single addGlyphs over the whole string, built by chunks of whole lines on the pool.
+    // Chunks are counted first, from the glyph tables only, then written into their slice of the arrays
+    void addGlyphsParallel(TextLayoutPool& pool, const GeometryStyle& style, const sf::String& string, GeometryCursor& cursor,
+                           sf::VertexArray& vertices, sf::VertexArray& outlineVertices, std::vector<std::size_t>& glyphVertices, std::vector<std::size_t>& glyphOutlineVertices)
+    {
+        // Few thousand characters per chunk, cut after a line break
+        const std::size_t chunkLength = 4096;
+
+        RICH_TEXT_TRACE_ZONE_ARG("ColorText::addGlyphsParallel", "length", string.getSize());
+
+        const std::vector<GlyphVertexCount> meshCounts = loadGlyphs(style, string, cursor.prevChar);
+
+        // Starting state of each chunk, the pen y is accumulated the way the serial loop does it
+        std::vector<std::size_t>    starts(1, 0);
+        std::vector<GeometryCursor> cursors(1, cursor);
+        float y = cursor.y;
+        for (std::size_t i = 0; i < string.getSize(); ++i)
+        {
+            if (string[i] != L'\n')
+                continue;
+
+            y += style.lineSpacing;
+
+            if (i + 1 < string.getSize() && i + 1 - starts.back() >= chunkLength)
+            {
+                GeometryCursor start = cursor;
+                start.x        = 0.f;
+                start.y        = y;
+                start.prevChar = L'\n';
+
+                starts.push_back(i + 1);
+                cursors.push_back(start);
+            }
+        }
+        starts.push_back(string.getSize());
+
+        const std::size_t chunks = cursors.size();
+        std::vector<std::size_t> fillBase(chunks + 1, 0);
+        std::vector<std::size_t> outlineBase(chunks + 1, 0);
+
+        pool.parallelFor(chunks, 1, [&](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t chunk = begin; chunk < end; ++chunk)
+            {
+                countGlyphs(style, string, starts[chunk], starts[chunk + 1], cursors[chunk].prevChar, meshCounts, fillBase[chunk + 1], outlineBase[chunk + 1]);
+            }
+        });
+
+        for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+        {
+            fillBase[chunk + 1]    += fillBase[chunk];
+            outlineBase[chunk + 1] += outlineBase[chunk];
+        }
+
+        vertices.resize(fillBase[chunks]);
+        outlineVertices.resize(outlineBase[chunks]);
+
+        pool.parallelFor(chunks, 1, [&](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t chunk = begin; chunk < end; ++chunk)
+            {
+                VertexSlice fill    = {fillBase[chunks]    ? &vertices[0] + fillBase[chunk]           : NULL, fillBase[chunk],    0};
+                VertexSlice outline = {outlineBase[chunks] ? &outlineVertices[0] + outlineBase[chunk] : NULL, outlineBase[chunk], 0};
+                addGlyphs(style, string, starts[chunk], starts[chunk + 1], cursors[chunk], fill, outline, &glyphVertices[0], &glyphOutlineVertices[0]);
+            }
+        });
+
+        // Merge the bounds, the pen ends where the last chunk left it
+        GeometryCursor merged = cursors.back();
+        for (std::size_t chunk = 0; chunk + 1 < chunks; ++chunk)
+        {
+            merged.minX = std::min(merged.minX, cursors[chunk].minX);
+            merged.minY = std::min(merged.minY, cursors[chunk].minY);
+            merged.maxX = std::max(merged.maxX, cursors[chunk].maxX);
+            merged.maxY = std::max(merged.maxY, cursors[chunk].maxY);
+        }
+        cursor = merged;
+    }
 }
 
 
@@ -62,7 +426,11 @@ m_vertices           (sf::PrimitiveType::Triangles),
 m_outlineVertices    (sf::PrimitiveType::Triangles),
 m_bounds             (),
 m_geometryNeedUpdate (false),
-m_fontTextureId      (0)
+m_fontTextureId      (0),
+m_visibleCount       (static_cast<std::size_t>(-1)),
+m_vectorGeometry     (false),
+m_layoutPool         (NULL),
+m_parallelLength     (65536)
 {
 
 }
@@ -83,12 +451,24 @@ m_vertices           (sf::PrimitiveType::Triangles),
 m_outlineVertices    (sf::PrimitiveType::Triangles),
 m_bounds             (),
 m_geometryNeedUpdate (true),
-m_fontTextureId      (0)
+m_fontTextureId      (0),
+m_visibleCount       (static_cast<std::size_t>(-1)),
+m_vectorGeometry     (false),
+m_layoutPool         (NULL),
+m_parallelLength     (65536)
 {
 
 }
 
 
+////////////////////////////////////////////////////////////
+void ColorText::setLayoutPool(TextLayoutPool* pool, std::size_t minimumLength)
+{
+    m_layoutPool     = pool;
+    m_parallelLength = minimumLength;
+}
+
+
 ////////////////////////////////////////////////////////////
 void ColorText::setString(const sf::String& string)
 {
@@ -96,6 +476,8 @@ void ColorText::setString(const sf::String& string)
     {
         m_string = string;
         m_geometryNeedUpdate = true;
+        m_characterPositions.clear();
+        m_glyphEffects.clear();
     }
 }
 
@@ -107,6 +489,7 @@ void ColorText::setFont(const ColorFont& font)
     {
         m_font = &font;
         m_geometryNeedUpdate = true;
+        m_characterPositions.clear();
     }
 }
 
@@ -118,6 +501,7 @@ void ColorText::setCharacterSize(unsigned int size)
     {
         m_characterSize = size;
         m_geometryNeedUpdate = true;
+        m_characterPositions.clear();
     }
 }
 
@@ -129,6 +513,7 @@ void ColorText::setLetterSpacing(float spacingFactor)
     {
         m_letterSpacingFactor = spacingFactor;
         m_geometryNeedUpdate = true;
+        m_characterPositions.clear();
     }
 }
 
@@ -140,6 +525,7 @@ void ColorText::setLineSpacing(float spacingFactor)
     {
         m_lineSpacingFactor = spacingFactor;
         m_geometryNeedUpdate = true;
+        m_characterPositions.clear();
     }
 }
 
@@ -151,6 +537,7 @@ void ColorText::setStyle(sf::Uint32 style)
     {
         m_style = style;
         m_geometryNeedUpdate = true;
+        m_characterPositions.clear();
     }
 }
 
@@ -167,6 +554,9 @@ void ColorText::setFillColor(const sf::Color& color)
             auto real_fill_color = m_font && m_font->isColorEmojiFont() ? sf::Color::White : m_fillColor;
             for (std::size_t i = 0; i < m_vertices.getVertexCount(); ++i)
                 m_vertices[i].color = real_fill_color;
+
+            for (std::size_t i = 0; i < m_glyphEffects.size(); ++i)
+                applyCharacterColor(i);
         }
     }
 }
@@ -185,6 +575,9 @@ void ColorText::setOutlineColor(const sf::Color& color)
         {
             for (std::size_t i = 0; i < m_outlineVertices.getVertexCount(); ++i)
                 m_outlineVertices[i].color = m_outlineColor;
+
+            for (std::size_t i = 0; i < m_glyphEffects.size(); ++i)
+                applyCharacterColor(i);
         }
     }
 }
@@ -267,49 +660,51 @@ float ColorText::getOutlineThickness() const
 ////////////////////////////////////////////////////////////
 sf::Vector2f ColorText::findCharacterPos(std::size_t index) const
 {
-    using namespace sf;
     // Make sure that we have a valid font
     if (!m_font)
         return Vector2f();
 
+    ensureCharacterPositions();
+
     // Adjust the index if it's out of range
     if (index > m_string.getSize())
         index = m_string.getSize();
 
-    // Precompute the variables needed by the algorithm
-    bool  isBold          = m_style & sf::Text::Bold;
-    float whitespaceWidth = m_font->getGlyph(L' ', m_characterSize, isBold).advance;
-    float letterSpacing   = ( whitespaceWidth / 3.f ) * ( m_letterSpacingFactor - 1.f );
-    whitespaceWidth      += letterSpacing;
-    float lineSpacing     = m_font->getLineSpacing(m_characterSize) * m_lineSpacingFactor;
+    // Transform the position to global coordinates
+    return getTransform().transformPoint(m_characterPositions[index]);
+}
 
-    // Compute the position
-    Vector2f position;
-    Uint32 prevChar = 0;
-    for (std::size_t i = 0; i < index; ++i)
-    {
-        Uint32 curChar = m_string[i];
 
-        // Apply the kerning offset
-        position.x += m_font->getKerning(prevChar, curChar, m_characterSize, isBold);
-        prevChar = curChar;
+////////////////////////////////////////////////////////////
+std::size_t ColorText::findCharacterIndex(sf::Vector2f point) const
+{
+    if (!m_font)
+        return 0;
 
-        // Handle special characters
-        switch (curChar)
-        {
-            case ' ':  position.x += whitespaceWidth;             continue;
-            case '\t': position.x += whitespaceWidth * 4;         continue;
-            case '\n': position.y += lineSpacing; position.x = 0; continue;
-        }
+    ensureCharacterPositions();
 
-        // For regular characters, add the advance offset of the glyph
-        position.x += m_font->getGlyph(curChar, m_characterSize, isBold).advance + letterSpacing;
-    }
+    point = getInverseTransform().transformPoint(point);
 
-    // Transform the position to global coordinates
-    position = getTransform().transformPoint(position);
+    std::vector<Vector2f>::const_iterator begin = m_characterPositions.begin();
+    std::vector<Vector2f>::const_iterator end   = m_characterPositions.end();
+
+    // Positions are sorted by line then by x: first find the last line starting above the point...
+    std::vector<Vector2f>::const_iterator below = std::upper_bound(begin, end, point.y, [](float y, const Vector2f& position) { return y < position.y; });
+    float lineY = (below == begin) ? begin->y : (below - 1)->y;
+
+    std::vector<Vector2f>::const_iterator lineBegin = std::lower_bound(begin, end, lineY, [](const Vector2f& position, float y) { return position.y < y; });
+    std::vector<Vector2f>::const_iterator lineEnd   = std::upper_bound(lineBegin, end, lineY, [](float y, const Vector2f& position) { return y < position.y; });
+
+    // ...then the closest caret position on that line
+    std::vector<Vector2f>::const_iterator it = std::lower_bound(lineBegin, lineEnd, point.x,
+        [](const Vector2f& position, float x) { return position.x < x; });
 
-    return position;
+    if (it == lineEnd)
+        --it;
+    else if (it != lineBegin && point.x - (it - 1)->x < it->x - point.x)
+        --it;
+
+    return static_cast<std::size_t>(it - m_characterPositions.begin());
 }
 
 
@@ -329,192 +724,300 @@ sf::FloatRect ColorText::getGlobalBounds() const
 }
 
 
+////////////////////////////////////////////////////////////
+void ColorText::setVisibleCharacterCount(std::size_t count)
+{
+    m_visibleCount = count;
+}
+
+
+////////////////////////////////////////////////////////////
+std::size_t ColorText::getVisibleCharacterCount() const
+{
+    return std::min(m_visibleCount, m_string.getSize());
+}
+
+
+////////////////////////////////////////////////////////////
+void ColorText::setCharacterColor(std::size_t index, const sf::Color& color)
+{
+    if (index >= m_string.getSize())
+        return;
+
+    if (m_glyphEffects.size() < m_string.getSize())
+        m_glyphEffects.resize(m_string.getSize());
+
+    m_glyphEffects[index].hasColor = true;
+    m_glyphEffects[index].color = color;
+
+    // Otherwise it gets applied with the new geometry
+    if (!m_geometryNeedUpdate)
+        applyCharacterColor(index);
+}
+
+
+////////////////////////////////////////////////////////////
+void ColorText::setCharacterOffset(std::size_t index, sf::Vector2f offset)
+{
+    if (index >= m_string.getSize())
+        return;
+
+    if (m_glyphEffects.size() < m_string.getSize())
+        m_glyphEffects.resize(m_string.getSize());
+
+    Vector2f delta = offset - m_glyphEffects[index].offset;
+    m_glyphEffects[index].offset = offset;
+
+    if (!m_geometryNeedUpdate)
+        moveCharacter(index, delta);
+}
+
+
+////////////////////////////////////////////////////////////
+void ColorText::resetCharacterEffects()
+{
+    if (m_glyphEffects.empty())
+        return;
+
+    m_glyphEffects.clear();
+    m_geometryNeedUpdate = true;
+}
+
+
 ////////////////////////////////////////////////////////////
 void ColorText::draw(sf::RenderTarget& target, sf::RenderStates states) const
 {
+    RICH_TEXT_TRACE_ZONE("ColorText::draw");
+
     if (m_font)
     {
         ensureGeometryUpdate();
 
         states.transform *= getTransform();
-        states.texture = &m_font->getTexture(m_characterSize);
+        states.texture = m_vectorGeometry ? NULL : &m_font->getTexture(m_characterSize);
+
+        // Progressive reveal, the glyphs of hidden characters are just not submitted
+        std::size_t fillCount    = m_vertices.getVertexCount();
+        std::size_t outlineCount = m_outlineVertices.getVertexCount();
+        if (m_visibleCount < m_string.getSize())
+        {
+            fillCount    = m_glyphVertices[m_visibleCount];
+            outlineCount = m_glyphOutlineVertices[m_visibleCount];
+        }
 
         // Only draw the outline if there is something to draw
-        if (m_outlineThickness != 0)
-            target.draw(m_outlineVertices, states);
-        
-        target.draw(m_vertices, states);
+        if (m_outlineThickness != 0 && outlineCount)
+        {
+            target.draw(&m_outlineVertices[0], outlineCount, sf::PrimitiveType::Triangles, states);
+            RICH_TEXT_COUNT(RichTextCounters::global(), DrawCalls, 1);
+        }
+
+        if (fillCount)
+        {
+            target.draw(&m_vertices[0], fillCount, sf::PrimitiveType::Triangles, states);
+            RICH_TEXT_COUNT(RichTextCounters::global(), DrawCalls, 1);
+        }
     }
 }
 
 
 ////////////////////////////////////////////////////////////
-void ColorText::ensureGeometryUpdate() const
+void ColorText::applyCharacterColor(std::size_t index) const
 {
-    if (!m_font)
+    const GlyphEffect& effect = m_glyphEffects[index];
+    if (!effect.hasColor)
         return;
 
-    // Do nothing, if geometry has not changed and the font texture has not changed
-    if (!m_geometryNeedUpdate)
-        return;
+    // Color emoji keep their colors, only the alpha is used to fade them
+    Color fillColor = m_font->isColorEmojiFont() ? Color(255, 255, 255, effect.color.a) : effect.color;
+    Color outlineColor(m_outlineColor.r, m_outlineColor.g, m_outlineColor.b, static_cast<Uint8>(m_outlineColor.a * effect.color.a / 255));
 
-    m_fontTextureId = 777;
+    for (std::size_t i = m_glyphVertices[index]; i < m_glyphVertices[index + 1]; ++i)
+        m_vertices[i].color = fillColor;
 
-    // Mark geometry as updated
-    m_geometryNeedUpdate = false;
+    for (std::size_t i = m_glyphOutlineVertices[index]; i < m_glyphOutlineVertices[index + 1]; ++i)
+        m_outlineVertices[i].color = outlineColor;
+}
 
-    // Clear the previous geometry
-    m_vertices.clear();
-    m_outlineVertices.clear();
-    m_bounds = FloatRect();
 
-    // No text: nothing to draw
-    if (m_string.isEmpty())
+////////////////////////////////////////////////////////////
+void ColorText::moveCharacter(std::size_t index, sf::Vector2f delta) const
+{
+    if (delta == Vector2f())
         return;
 
-    // Compute values related to the text style
-    bool  isBold             = m_style & sf::Text::Bold;
-    bool  isUnderlined       = m_style & sf::Text::Underlined;
-    bool  isStrikeThrough    = m_style & sf::Text::StrikeThrough;
-    float italicShear        = (m_style & sf::Text::Italic) ? 0.209f : 0.f; // 12 degrees in radians
-    float underlineOffset    = m_font->getUnderlinePosition(m_characterSize);
-    float underlineThickness = m_font->getUnderlineThickness(m_characterSize);
+    for (std::size_t i = m_glyphVertices[index]; i < m_glyphVertices[index + 1]; ++i)
+        m_vertices[i].position += delta;
+
+    for (std::size_t i = m_glyphOutlineVertices[index]; i < m_glyphOutlineVertices[index + 1]; ++i)
+        m_outlineVertices[i].position += delta;
+}
 
-    // Compute the location of the strike through dynamically
-    // We use the center point of the lowercase 'x' glyph as the reference
-    // We reuse the underline thickness as the thickness of the strike through as well
-    FloatRect xBounds = m_font->getGlyph(L'x', m_characterSize, isBold).bounds;
-    float strikeThroughOffset = xBounds.top + xBounds.height / 2.f;
+
+////////////////////////////////////////////////////////////
+void ColorText::ensureCharacterPositions() const
+{
+    // The table always holds the position after the last character, so empty means outdated
+    if (!m_characterPositions.empty())
+        return;
+
+    m_characterPositions.resize(m_string.getSize() + 1);
 
     // Precompute the variables needed by the algorithm
-    float whitespaceWidth = m_font->getGlyph(L' ', m_characterSize, isBold).advance;
+    bool  isBold          = m_style & sf::Text::Bold;
+    float whitespaceWidth = m_font->getGlyphMetrics(L' ', m_characterSize, isBold).advance;
     float letterSpacing   = ( whitespaceWidth / 3.f ) * ( m_letterSpacingFactor - 1.f );
     whitespaceWidth      += letterSpacing;
     float lineSpacing     = m_font->getLineSpacing(m_characterSize) * m_lineSpacingFactor;
-    float x               = 0.f;
-    float y               = static_cast<float>(m_characterSize);
 
-    // Create one quad for each character
-    float minX = static_cast<float>(m_characterSize);
-    float minY = static_cast<float>(m_characterSize);
-    float maxX = 0.f;
-    float maxY = 0.f;
+    // Compute the position of every character in a single pass
+    Vector2f position;
     Uint32 prevChar = 0;
     for (std::size_t i = 0; i < m_string.getSize(); ++i)
     {
-        Uint32 curChar = m_string[i];
+        m_characterPositions[i] = position;
 
-        // Skip the \r char to avoid weird graphical issues
-        if (curChar == L'\r')
-            continue;
+        Uint32 curChar = m_string[i];
 
         // Apply the kerning offset
-        x += m_font->getKerning(prevChar, curChar, m_characterSize, isBold);
+        position.x += m_font->getKerning(prevChar, curChar, m_characterSize, isBold);
+        prevChar = curChar;
 
-        // If we're using the underlined style and there's a new line, draw a line
-        if (isUnderlined && (curChar == L'\n' && prevChar != L'\n'))
+        // Handle special characters
+        switch (curChar)
         {
-            addLine(m_vertices, x, y, m_fillColor, underlineOffset, underlineThickness);
-
-            if (m_outlineThickness != 0)
-                addLine(m_outlineVertices, x, y, m_outlineColor, underlineOffset, underlineThickness, m_outlineThickness);
+            case ' ':  position.x += whitespaceWidth;             continue;
+            case '\t': position.x += whitespaceWidth * 4;         continue;
+            case '\n': position.y += lineSpacing; position.x = 0; continue;
         }
 
-        // If we're using the strike through style and there's a new line, draw a line across all characters
-        if (isStrikeThrough && (curChar == L'\n' && prevChar != L'\n'))
-        {
-            addLine(m_vertices, x, y, m_fillColor, strikeThroughOffset, underlineThickness);
-
-            if (m_outlineThickness != 0)
-                addLine(m_outlineVertices, x, y, m_outlineColor, strikeThroughOffset, underlineThickness, m_outlineThickness);
-        }
+        // For regular characters, add the advance offset of the glyph (metrics only, nothing gets rasterized)
+        position.x += m_font->getGlyphMetrics(curChar, m_characterSize, isBold).advance + letterSpacing;
+    }
 
-        prevChar = curChar;
+    m_characterPositions[m_string.getSize()] = position;
+}
 
-        // Handle special characters
-        if ((curChar == L' ') || (curChar == L'\n') || (curChar == L'\t'))
-        {
-            // Update the current bounds (min coordinates)
-            minX = std::min(minX, x);
-            minY = std::min(minY, y);
 
-            switch (curChar)
-            {
-                case L' ':  x += whitespaceWidth;     break;
-                case L'\t': x += whitespaceWidth * 4; break;
-                case L'\n': y += lineSpacing; x = 0;  break;
-            }
+////////////////////////////////////////////////////////////
+void ColorText::ensureGeometryUpdate() const
+{
+    if (!m_font)
+        return;
 
-            // Update the current bounds (max coordinates)
-            maxX = std::max(maxX, x);
-            maxY = std::max(maxY, y);
+    // Do nothing, if geometry has not changed and the font texture has not changed
+    // (a page released by ColorFont::trim comes back with a new id and different texture rects)
+    if (!m_geometryNeedUpdate && (m_vectorGeometry || m_font->getPageId(m_characterSize) == m_fontTextureId))
+        return;
 
-            // Next glyph, no need to create a quad for whitespace
-            continue;
-        }
+    RICH_TEXT_TRACE_ZONE_ARG("ColorText::ensureGeometryUpdate", "length", m_string.getSize());
 
-        // Apply the outline
-        if (m_outlineThickness != 0)
-        {
-            const Glyph& glyph = m_font->getGlyph(curChar, m_characterSize, isBold, m_outlineThickness);
+    // Mark geometry as updated
+    m_geometryNeedUpdate = false;
 
-            // Add the outline glyph to the vertices
-            addGlyphQuad(m_outlineVertices, Vector2f(x, y), m_outlineColor, glyph, italicShear);
-        }
+    // Clear the previous geometry
+    m_vertices.clear();
+    m_outlineVertices.clear();
+    m_bounds = FloatRect();
+    m_glyphVertices.assign(m_string.getSize() + 1, 0);
+    m_glyphOutlineVertices.assign(m_string.getSize() + 1, 0);
 
-        // Extract the current glyph's description
-        const Glyph& glyph = m_font->getGlyph(curChar, m_characterSize, isBold);
+    // No text: nothing to draw
+    if (m_string.isEmpty())
+    {
+        m_fontTextureId = m_font->getPageId(m_characterSize);
+        return;
+    }
 
-        // Add the glyph to the vertices
-        auto real_fill_color = m_font->isColorEmojiFont() ? sf::Color::White : m_fillColor;
-        addGlyphQuad(m_vertices, Vector2f(x, y), real_fill_color, glyph, italicShear);
+    // Compute values related to the text style
+    GeometryStyle style;
+    style.font               = m_font;
+    style.characterSize      = m_characterSize;
+    style.bold               = m_style & sf::Text::Bold;
+    style.underlined         = m_style & sf::Text::Underlined;
+    style.strikeThrough      = m_style & sf::Text::StrikeThrough;
+    style.italicShear        = (m_style & sf::Text::Italic) ? 0.209f : 0.f; // 12 degrees in radians
+    style.underlineOffset    = m_font->getUnderlinePosition(m_characterSize);
+    style.underlineThickness = m_font->getUnderlineThickness(m_characterSize);
+    style.outlineThickness   = m_outlineThickness;
+    style.fillColor          = m_fillColor;
+    style.outlineColor       = m_outlineColor;
+
+    // Very large glyphs are drawn from their outlines, they are only measured and never rasterized
+    style.vectorGlyphs       = m_font->isVectorSize(m_characterSize);
+    m_vectorGeometry         = style.vectorGlyphs;
 
-        // Update the current bounds
-        float left   = glyph.bounds.left;
-        float top    = glyph.bounds.top;
-        float right  = glyph.bounds.left + glyph.bounds.width;
-        float bottom = glyph.bounds.top + glyph.bounds.height;
+    // Compute the location of the strike through dynamically
+    // We use the center point of the lowercase 'x' glyph as the reference
+    // We reuse the underline thickness as the thickness of the strike through as well
+    FloatRect xBounds = (style.vectorGlyphs ? m_font->getGlyphMetrics(L'x', m_characterSize, style.bold) : m_font->getGlyph(L'x', m_characterSize, style.bold)).bounds;
+    style.strikeThroughOffset = xBounds.top + xBounds.height / 2.f;
 
-        minX = std::min(minX, x + left - italicShear * bottom);
-        maxX = std::max(maxX, x + right - italicShear * top);
-        minY = std::min(minY, y + top);
-        maxY = std::max(maxY, y + bottom);
+    // Precompute the variables needed by the algorithm
+    float whitespaceWidth  = (style.vectorGlyphs ? m_font->getGlyphMetrics(L' ', m_characterSize, style.bold) : m_font->getGlyph(L' ', m_characterSize, style.bold)).advance;
+    style.letterSpacing    = ( whitespaceWidth / 3.f ) * ( m_letterSpacingFactor - 1.f );
+    style.whitespaceWidth  = whitespaceWidth + style.letterSpacing;
+    style.lineSpacing      = m_font->getLineSpacing(m_characterSize) * m_lineSpacingFactor;
 
-        // Advance to the next character
-        x += glyph.advance + letterSpacing;
-    }
+    // Create one quad for each character
+    GeometryCursor cursor;
+    cursor.x        = 0.f;
+    cursor.y        = static_cast<float>(m_characterSize);
+    cursor.prevChar = 0;
+    cursor.minX     = static_cast<float>(m_characterSize);
+    cursor.minY     = static_cast<float>(m_characterSize);
+    cursor.maxX     = 0.f;
+    cursor.maxY     = 0.f;
+
+    if (m_layoutPool && m_string.getSize() >= m_parallelLength)
+        addGlyphsParallel(*m_layoutPool, style, m_string, cursor, m_vertices, m_outlineVertices, m_glyphVertices, m_glyphOutlineVertices);
+    else
+        addGlyphs(style, m_string, 0, m_string.getSize(), cursor, m_vertices, m_outlineVertices, &m_glyphVertices[0], &m_glyphOutlineVertices[0]);
+
+    m_glyphVertices[m_string.getSize()]        = m_vertices.getVertexCount();
+    m_glyphOutlineVertices[m_string.getSize()] = m_outlineVertices.getVertexCount();
 
     // If we're using outline, update the current bounds
     if (m_outlineThickness != 0)
     {
         float outline = std::abs(std::ceil(m_outlineThickness));
-        minX -= outline;
-        maxX += outline;
-        minY -= outline;
-        maxY += outline;
+        cursor.minX -= outline;
+        cursor.maxX += outline;
+        cursor.minY -= outline;
+        cursor.maxY += outline;
     }
 
     // If we're using the underlined style, add the last line
-    if (isUnderlined && (x > 0))
+    if (style.underlined && (cursor.x > 0))
     {
-        addLine(m_vertices, x, y, m_fillColor, underlineOffset, underlineThickness);
+        addLine(m_vertices, cursor.x, cursor.y, m_fillColor, style.underlineOffset, style.underlineThickness);
 
         if (m_outlineThickness != 0)
-            addLine(m_outlineVertices, x, y, m_outlineColor, underlineOffset, underlineThickness, m_outlineThickness);
+            addLine(m_outlineVertices, cursor.x, cursor.y, m_outlineColor, style.underlineOffset, style.underlineThickness, m_outlineThickness);
     }
 
     // If we're using the strike through style, add the last line across all characters
-    if (isStrikeThrough && (x > 0))
+    if (style.strikeThrough && (cursor.x > 0))
     {
-        addLine(m_vertices, x, y, m_fillColor, strikeThroughOffset, underlineThickness);
+        addLine(m_vertices, cursor.x, cursor.y, m_fillColor, style.strikeThroughOffset, style.underlineThickness);
 
         if (m_outlineThickness != 0)
-            addLine(m_outlineVertices, x, y, m_outlineColor, strikeThroughOffset, underlineThickness, m_outlineThickness);
+            addLine(m_outlineVertices, cursor.x, cursor.y, m_outlineColor, style.strikeThroughOffset, style.underlineThickness, m_outlineThickness);
     }
 
     // Update the bounding rectangle
-    m_bounds.left = minX;
-    m_bounds.top = minY;
-    m_bounds.width = maxX - minX;
-    m_bounds.height = maxY - minY;
+    m_bounds.left = cursor.minX;
+    m_bounds.top = cursor.minY;
+    m_bounds.width = cursor.maxX - cursor.minX;
+    m_bounds.height = cursor.maxY - cursor.minY;
+
+    // Glyphs were loaded into the page by now, it may have just been created
+    m_fontTextureId = style.vectorGlyphs ? 0 : m_font->getPageId(m_characterSize);
+
+    // Reapply the per glyph effects on the new geometry
+    for (std::size_t i = 0; i < m_glyphEffects.size(); ++i)
+    {
+        applyCharacterColor(i);
+        moveCharacter(i, m_glyphEffects[i].offset);
+    }
 }
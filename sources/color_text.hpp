@@ -6,6 +6,8 @@
 #include <SFML/System/String.hpp>
 #include <SFML/Graphics/VertexArray.hpp>
 
+class TextLayoutPool;
+
 class ColorText : public sf::Drawable, public sf::Transformable
 {
 public:
@@ -52,16 +54,48 @@ public:
 
     sf::Vector2f findCharacterPos(std::size_t index) const;
 
+    std::size_t findCharacterIndex(sf::Vector2f point) const;
+
     sf::FloatRect getLocalBounds() const;
 
     sf::FloatRect getGlobalBounds() const;
 
+    // Per glyph effects, they patch the vertices of the affected characters only and survive geometry
+    // updates until the string changes. Offsets are not part of the bounds, they are meant for animation
+
+    void setVisibleCharacterCount(std::size_t count);
+
+    std::size_t getVisibleCharacterCount() const;
+
+    void setCharacterColor(std::size_t index, const sf::Color& color);
+
+    void setCharacterOffset(std::size_t index, sf::Vector2f offset);
+
+    void resetCharacterEffects();
+
+    // Strings of at least 'minimumLength' characters get their geometry built on the pool, by chunks of
+    // whole lines. Null builds everything on the calling thread, which is the default
+    void setLayoutPool(TextLayoutPool* pool, std::size_t minimumLength = 65536);
+
 private:
 
+    struct GlyphEffect
+    {
+        bool         hasColor = false;
+        sf::Color    color;
+        sf::Vector2f offset;
+    };
+
     virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
 
     void ensureGeometryUpdate() const;
 
+    void ensureCharacterPositions() const;
+
+    void applyCharacterColor(std::size_t index) const;
+
+    void moveCharacter(std::size_t index, sf::Vector2f delta) const;
+
     sf::String              m_string;              //!< String to display
     const ColorFont*         m_font;                //!< Font used to display the string
     unsigned int        m_characterSize;       //!< Base size of characters, in pixels
@@ -76,4 +110,12 @@ private:
     mutable sf::FloatRect   m_bounds;              //!< Bounding rectangle of the text (in local coordinates)
     mutable bool        m_geometryNeedUpdate;  //!< Does the geometry need to be recomputed?
     mutable sf::Uint64      m_fontTextureId;       //!< The font texture id
+    mutable std::vector<sf::Vector2f> m_characterPositions; //!< Local position before each character, plus the end position (empty when outdated)
+    mutable std::vector<std::size_t> m_glyphVertices;        //!< First fill vertex of each character, plus the vertex count
+    mutable std::vector<std::size_t> m_glyphOutlineVertices; //!< First outline vertex of each character, plus the vertex count
+    std::vector<GlyphEffect> m_glyphEffects;                 //!< Per character color and offset (empty when unused)
+    std::size_t         m_visibleCount;        //!< Number of characters drawn
+    mutable bool        m_vectorGeometry;      //!< Is the geometry made of untextured glyph meshes instead of page quads?
+    TextLayoutPool*     m_layoutPool;          //!< Workers building the geometry of long strings (null for none)
+    std::size_t         m_parallelLength;      //!< Minimum string length built on the layout pool
 };
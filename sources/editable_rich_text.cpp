@@ -0,0 +1,749 @@
+#include "editable_rich_text.hpp"
+#include <SFML/Graphics/RenderTarget.hpp>
+#include <algorithm>
+#include <cmath>
+
+PieceTable::PieceTable(const PieceTable& other):
+    m_Original(other.m_Original),
+    m_Added(other.m_Added),
+    m_Root(clone(other.m_Root.get())),
+    m_Size(other.m_Size),
+    m_Seed(other.m_Seed)
+{}
+
+PieceTable &PieceTable::operator=(const PieceTable& other){
+    if(this != &other)
+        *this = PieceTable(other);
+
+    return *this;
+}
+
+void PieceTable::assign(const sf::String& string){
+    m_Original.assign(string.getData(), string.getSize());
+    m_Added.clear();
+    m_Root.reset();
+    m_Size = string.getSize();
+
+    if(m_Size)
+        m_Root = makeNode({false, 0, m_Size});
+}
+
+void PieceTable::insert(std::size_t index, const sf::String& string){
+    if(string.isEmpty())
+        return;
+
+    NodePtr left, right;
+    split(std::move(m_Root), std::min(index, m_Size), left, right);
+
+    Node *prev = left.get();
+    while(prev && prev->Right)
+        prev = prev->Right.get();
+
+    // Typing keeps appending right after the previous insertion, extend its piece instead of adding one
+    if(prev && prev->Value.Added && prev->Value.Start + prev->Value.Length == m_Added.size()){
+        for(Node *node = left.get(); node; node = node->Right.get())
+            node->Length += string.getSize();
+
+        prev->Value.Length += string.getSize();
+    }else{
+        left = merge(std::move(left), makeNode({true, m_Added.size(), string.getSize()}));
+    }
+
+    m_Root = merge(std::move(left), std::move(right));
+
+    m_Added.append(string.getData(), string.getSize());
+    m_Size += string.getSize();
+}
+
+void PieceTable::erase(std::size_t index, std::size_t count){
+    index = std::min(index, m_Size);
+    count = std::min(count, m_Size - index);
+
+    if(!count)
+        return;
+
+    NodePtr left, middle, right;
+    split(std::move(m_Root), index, left, middle);
+    split(std::move(middle), count, middle, right);
+
+    m_Root = merge(std::move(left), std::move(right));
+    m_Size -= count;
+}
+
+std::size_t PieceTable::getSize()const{
+    return m_Size;
+}
+
+sf::String PieceTable::substring(std::size_t index, std::size_t count)const{
+    std::basic_string<sf::Uint32> result;
+
+    index = std::min(index, m_Size);
+    count = std::min(count, m_Size - index);
+    result.reserve(count);
+
+    collect(m_Root.get(), index, count, result);
+
+    return sf::String(result);
+}
+
+PieceTable::NodePtr PieceTable::makeNode(const Piece& piece){
+    // xorshift32, balance only needs the priorities to look random
+    m_Seed ^= m_Seed << 13;
+    m_Seed ^= m_Seed >> 17;
+    m_Seed ^= m_Seed << 5;
+
+    NodePtr node(new Node());
+    node->Value = piece;
+    node->Priority = m_Seed;
+    node->Length = piece.Length;
+    return node;
+}
+
+PieceTable::NodePtr PieceTable::clone(const Node* node){
+    if(!node)
+        return nullptr;
+
+    NodePtr copy(new Node());
+    copy->Value = node->Value;
+    copy->Priority = node->Priority;
+    copy->Length = node->Length;
+    copy->Left = clone(node->Left.get());
+    copy->Right = clone(node->Right.get());
+    return copy;
+}
+
+void PieceTable::update(Node& node){
+    node.Length = node.Value.Length
+        + (node.Left ? node.Left->Length : 0)
+        + (node.Right ? node.Right->Length : 0);
+}
+
+void PieceTable::split(NodePtr node, std::size_t index, NodePtr& left, NodePtr& right){
+    if(!node){
+        left.reset();
+        right.reset();
+        return;
+    }
+
+    const std::size_t left_length = node->Left ? node->Left->Length : 0;
+
+    if(index <= left_length){
+        split(std::move(node->Left), index, left, node->Left);
+        update(*node);
+        right = std::move(node);
+    }else if(index >= left_length + node->Value.Length){
+        split(std::move(node->Right), index - left_length - node->Value.Length, node->Right, right);
+        update(*node);
+        left = std::move(node);
+    }else{
+        // The cut falls inside this piece, its tail heads the right side with the same priority
+        const std::size_t head = index - left_length;
+
+        NodePtr tail(new Node());
+        tail->Value = {node->Value.Added, node->Value.Start + head, node->Value.Length - head};
+        tail->Priority = node->Priority;
+        tail->Right = std::move(node->Right);
+        update(*tail);
+
+        node->Value.Length = head;
+        update(*node);
+
+        left = std::move(node);
+        right = std::move(tail);
+    }
+}
+
+PieceTable::NodePtr PieceTable::merge(NodePtr left, NodePtr right){
+    if(!left)
+        return right;
+    if(!right)
+        return left;
+
+    if(left->Priority > right->Priority){
+        left->Right = merge(std::move(left->Right), std::move(right));
+        update(*left);
+        return left;
+    }
+
+    right->Left = merge(std::move(left), std::move(right->Left));
+    update(*right);
+    return right;
+}
+
+void PieceTable::collect(const Node* node, std::size_t index, std::size_t& count, std::basic_string<sf::Uint32>& result)const{
+    if(!node || !count)
+        return;
+
+    const std::size_t left_length = node->Left ? node->Left->Length : 0;
+    const Piece &piece = node->Value;
+
+    if(index < left_length)
+        collect(node->Left.get(), index, count, result);
+
+    const std::size_t skip = index > left_length ? index - left_length : 0;
+
+    if(count && skip < piece.Length){
+        std::size_t length = std::min(piece.Length - skip, count);
+        const auto &buffer = piece.Added ? m_Added : m_Original;
+
+        result.append(buffer, piece.Start + skip, length);
+        count -= length;
+    }
+
+    if(count){
+        const std::size_t right_start = left_length + piece.Length;
+        collect(node->Right.get(), index > right_start ? index - right_start : 0, count, result);
+    }
+}
+
+namespace {
+    // In order walk shared by the const and mutable LineTable::forEach
+    template<typename NodeType, typename Visitor>
+    void VisitLines(NodeType *node, std::size_t &row, const Visitor &visit){
+        if(!node)
+            return;
+
+        VisitLines(node->Left.get(), row, visit);
+        visit(node->Value, row++);
+        VisitLines(node->Right.get(), row, visit);
+    }
+}
+
+EditableRichText::LineTable::LineTable(const LineTable& other):
+    m_Root(clone(other.m_Root.get())),
+    m_Seed(other.m_Seed)
+{}
+
+EditableRichText::LineTable &EditableRichText::LineTable::operator=(const LineTable& other){
+    if(this != &other)
+        *this = LineTable(other);
+
+    return *this;
+}
+
+void EditableRichText::LineTable::clear(){
+    m_Root.reset();
+}
+
+std::size_t EditableRichText::LineTable::getCount()const{
+    return m_Root ? m_Root->Count : 0;
+}
+
+const EditableRichText::Line &EditableRichText::LineTable::get(std::size_t line)const{
+    const Node *node = m_Root.get();
+
+    for (;;) {
+        const std::size_t left_count = node->Left ? node->Left->Count : 0;
+
+        if(line == left_count)
+            return node->Value;
+
+        if(line < left_count){
+            node = node->Left.get();
+        }else{
+            line -= left_count + 1;
+            node = node->Right.get();
+        }
+    }
+}
+
+std::size_t EditableRichText::LineTable::getStart(std::size_t line)const{
+    std::size_t start = 0;
+
+    for (const Node *node = m_Root.get(); node;) {
+        const std::size_t left_count = node->Left ? node->Left->Count : 0;
+
+        if(line < left_count){
+            node = node->Left.get();
+            continue;
+        }
+
+        start += node->Left ? node->Left->Length : 0;
+
+        if(line == left_count)
+            break;
+
+        start += node->Value.Length + node->Value.Break;
+        line -= left_count + 1;
+        node = node->Right.get();
+    }
+
+    return start;
+}
+
+std::size_t EditableRichText::LineTable::find(std::size_t index, std::size_t& start)const{
+    std::size_t line = 0;
+    start = 0;
+
+    for (const Node *node = m_Root.get(); node;) {
+        const std::size_t left_length = node->Left ? node->Left->Length : 0;
+
+        if(index < left_length){
+            node = node->Left.get();
+            continue;
+        }
+
+        const std::size_t left_count = node->Left ? node->Left->Count : 0;
+        const std::size_t length = node->Value.Length + node->Value.Break;
+
+        // Only the last line has nothing on its right, it also holds the end position
+        if(index < left_length + length || !node->Right){
+            start += left_length;
+            return line + left_count;
+        }
+
+        index -= left_length + length;
+        start += left_length + length;
+        line += left_count + 1;
+        node = node->Right.get();
+    }
+
+    return line;
+}
+
+void EditableRichText::LineTable::edit(std::size_t first, std::size_t last, const std::function<void(std::vector<Line>&)>& edit){
+    NodePtr left, middle, right;
+    split(std::move(m_Root), first, left, middle);
+    split(std::move(middle), last - first, middle, right);
+
+    std::vector<Line> lines;
+    collect(std::move(middle), lines);
+
+    edit(lines);
+
+    for(auto &line: lines)
+        left = merge(std::move(left), makeNode(std::move(line)));
+
+    m_Root = merge(std::move(left), std::move(right));
+}
+
+void EditableRichText::LineTable::forEach(const std::function<void(const Line&, std::size_t)>& visit)const{
+    std::size_t row = 0;
+    VisitLines(static_cast<const Node*>(m_Root.get()), row, visit);
+}
+
+void EditableRichText::LineTable::forEach(const std::function<void(Line&, std::size_t)>& visit){
+    std::size_t row = 0;
+    VisitLines(m_Root.get(), row, visit);
+}
+
+EditableRichText::LineTable::NodePtr EditableRichText::LineTable::makeNode(Line&& line){
+    // xorshift32, same as the piece table
+    m_Seed ^= m_Seed << 13;
+    m_Seed ^= m_Seed >> 17;
+    m_Seed ^= m_Seed << 5;
+
+    NodePtr node(new Node());
+    node->Value = std::move(line);
+    node->Priority = m_Seed;
+    update(*node);
+    return node;
+}
+
+EditableRichText::LineTable::NodePtr EditableRichText::LineTable::clone(const Node* node){
+    if(!node)
+        return nullptr;
+
+    NodePtr copy(new Node());
+    copy->Value = node->Value;
+    copy->Priority = node->Priority;
+    copy->Count = node->Count;
+    copy->Length = node->Length;
+    copy->Left = clone(node->Left.get());
+    copy->Right = clone(node->Right.get());
+    return copy;
+}
+
+void EditableRichText::LineTable::update(Node& node){
+    node.Count = 1
+        + (node.Left ? node.Left->Count : 0)
+        + (node.Right ? node.Right->Count : 0);
+    node.Length = node.Value.Length + node.Value.Break
+        + (node.Left ? node.Left->Length : 0)
+        + (node.Right ? node.Right->Length : 0);
+}
+
+void EditableRichText::LineTable::split(NodePtr node, std::size_t count, NodePtr& left, NodePtr& right){
+    if(!node){
+        left.reset();
+        right.reset();
+        return;
+    }
+
+    const std::size_t left_count = node->Left ? node->Left->Count : 0;
+
+    if(count <= left_count){
+        split(std::move(node->Left), count, left, node->Left);
+        update(*node);
+        right = std::move(node);
+    }else{
+        split(std::move(node->Right), count - left_count - 1, node->Right, right);
+        update(*node);
+        left = std::move(node);
+    }
+}
+
+EditableRichText::LineTable::NodePtr EditableRichText::LineTable::merge(NodePtr left, NodePtr right){
+    if(!left)
+        return right;
+    if(!right)
+        return left;
+
+    if(left->Priority > right->Priority){
+        left->Right = merge(std::move(left->Right), std::move(right));
+        update(*left);
+        return left;
+    }
+
+    right->Left = merge(std::move(left), std::move(right->Left));
+    update(*right);
+    return right;
+}
+
+void EditableRichText::LineTable::collect(NodePtr node, std::vector<Line>& lines){
+    if(!node)
+        return;
+
+    collect(std::move(node->Left), lines);
+    lines.push_back(std::move(node->Value));
+    collect(std::move(node->Right), lines);
+}
+
+void EditableRichText::setString(const sf::String& string){
+    m_Text.assign(string);
+
+    rebuild();
+}
+
+sf::String EditableRichText::getString()const{
+    return m_Text.substring(0, m_Text.getSize());
+}
+
+std::size_t EditableRichText::getSize()const{
+    return m_Text.getSize();
+}
+
+void EditableRichText::insert(std::size_t index, const sf::String& string){
+    replace(index, 0, string);
+}
+
+void EditableRichText::erase(std::size_t index, std::size_t count){
+    replace(index, count, {});
+}
+
+void EditableRichText::replace(std::size_t index, std::size_t count, const sf::String& string){
+    index = std::min(index, m_Text.getSize());
+    count = std::min(count, m_Text.getSize() - index);
+
+    if(!count && string.isEmpty())
+        return;
+
+    if(!drawn() || !m_Lines.getCount()){
+        m_Text.erase(index, count);
+        m_Text.insert(index, string);
+        m_Lines.clear();
+        m_BoundsNeedUpdate = true;
+        return;
+    }
+
+    std::size_t begin = 0, last_start = 0;
+    const std::size_t first_line = m_Lines.find(index, begin);
+    const std::size_t last_line = m_Lines.find(index + count, last_start);
+
+    // The lines below keep their geometry, they are drawn at their row and their starts follow from the lengths
+    if(first_line == last_line && string.find("\n") == sf::String::InvalidPos){
+        // Within one line: inserted characters may join the run before the edit point or the one
+        // holding the first character after the edit, so both are re-segmented along with the edited ones
+        const Line &line = m_Lines.get(first_line);
+        const std::size_t local = index - begin;
+
+        std::size_t first = 0, last = 0, run_begin = 0, run_end = 0;
+        if(line.Runs.size()){
+            first = findRun(line, local ? local - 1 : 0);
+            last = findRun(line, local + count) + 1;
+            run_begin = line.Runs[first].Start;
+            run_end = line.Runs[last - 1].Start + line.Runs[last - 1].Length;
+        }
+
+        m_Text.erase(index, count);
+        m_Text.insert(index, string);
+
+        m_Lines.edit(first_line, first_line + 1, [&](std::vector<Line> &lines) {
+            lines[0].Length = lines[0].Length - count + string.getSize();
+            relayout(lines[0], begin, first, last, run_begin, run_end - count + string.getSize());
+        });
+    }else{
+        // Line breaks come or go, the touched lines are split again
+        const Line &last = m_Lines.get(last_line);
+        const std::size_t end = last_start + last.Length + last.Break;
+
+        m_Text.erase(index, count);
+        m_Text.insert(index, string);
+
+        rebuildLines(first_line, last_line + 1, begin, end - count + string.getSize());
+    }
+}
+
+void EditableRichText::setCharacterSize(int size){
+    if(m_CharacterSize == size)
+        return;
+
+    m_CharacterSize = size;
+
+    rebuild();
+}
+
+void EditableRichText::setRichFont(const RichFont& font){
+    if(m_Font == &font)
+        return;
+
+    m_Font = &font;
+
+    rebuild();
+}
+
+void EditableRichText::setFillColor(const sf::Color& color){
+    m_FillColor = color;
+
+    m_Lines.forEach([&](Line &line, std::size_t) {
+        for(auto &run: line.Runs)
+            run.Text.setFillColor(color);
+    });
+}
+
+sf::FloatRect EditableRichText::getLocalBounds()const{
+    if(!m_BoundsNeedUpdate)
+        return m_Bounds;
+
+    m_BoundsNeedUpdate = false;
+    m_Bounds = {};
+
+    m_Lines.forEach([&](const Line &line, std::size_t row) {
+        for (const auto &run : line.Runs) {
+            sf::FloatRect bounds = run.Text.getGlobalBounds();
+            bounds.top += m_LineSpacing * row;
+
+            if (m_Bounds.width == 0 && m_Bounds.height == 0) {
+                m_Bounds = bounds;
+            } else {
+                float right = std::max(m_Bounds.left + m_Bounds.width, bounds.left + bounds.width);
+                float bottom = std::max(m_Bounds.top + m_Bounds.height, bounds.top + bounds.height);
+                m_Bounds.left = std::min(m_Bounds.left, bounds.left);
+                m_Bounds.top = std::min(m_Bounds.top, bounds.top);
+                m_Bounds.width = right - m_Bounds.left;
+                m_Bounds.height = bottom - m_Bounds.top;
+            }
+        }
+    });
+
+    return m_Bounds;
+}
+
+sf::Vector2f EditableRichText::findCharacterPos(std::size_t index)const{
+    if(!m_Lines.getCount())
+        return getTransform().transformPoint(0.f, 0.f);
+
+    index = std::min(index, m_Text.getSize());
+
+    std::size_t start = 0;
+    const std::size_t line_index = m_Lines.find(index, start);
+    const Line &line = m_Lines.get(line_index);
+    const float y = m_LineSpacing * line_index;
+
+    if(!line.Runs.size())
+        return getTransform().transformPoint(0.f, y);
+
+    const Run &run = line.Runs[findRun(line, index - start)];
+
+    std::size_t local = index - start - run.Start;
+
+    return getTransform().transformPoint(run.Text.findCharacterPos(local) + sf::Vector2f(0.f, y));
+}
+
+std::size_t EditableRichText::findCharacterIndex(sf::Vector2f point)const{
+    if(!m_Lines.getCount())
+        return 0;
+
+    point = getInverseTransform().transformPoint(point);
+
+    std::size_t line_index = 0;
+    if(m_LineSpacing > 0 && point.y > 0)
+        line_index = std::min(static_cast<std::size_t>(point.y / m_LineSpacing), m_Lines.getCount() - 1);
+
+    const Line &line = m_Lines.get(line_index);
+    const std::size_t start = m_Lines.getStart(line_index);
+
+    if(!line.Runs.size())
+        return start;
+
+    // Runs are laid out left to right, pick the last one starting before the point
+    auto it = std::upper_bound(line.Runs.begin(), line.Runs.end(), point.x, [](float x, const Run &run){
+        return x < run.Text.getPosition().x;
+    });
+
+    if(it != line.Runs.begin())
+        --it;
+
+    return start + it->Start + it->Text.findCharacterIndex(sf::Vector2f(point.x, point.y - m_LineSpacing * line_index));
+}
+
+bool EditableRichText::drawn()const{
+    return m_CharacterSize && m_Font && m_Font->valid();
+}
+
+void EditableRichText::rebuild(){
+    m_Lines.clear();
+    m_BoundsNeedUpdate = true;
+
+    if(!drawn())
+        return;
+
+    m_LineSpacing = m_Font->findFontForGlyph(L' ')->getLineSpacing(m_CharacterSize);
+
+    rebuildLines(0, 0, 0, m_Text.getSize());
+}
+
+void EditableRichText::rebuildLines(std::size_t first, std::size_t last, std::size_t begin, std::size_t end){
+    std::vector<Line> lines;
+    sf::String string = m_Text.substring(begin, end - begin);
+
+    auto Emit = [&](std::size_t line_start, std::size_t line_end, bool line_break) {
+        Line line;
+        line.Length = line_end - line_start;
+        line.Break = line_break;
+        relayout(line, begin + line_start, 0, 0, 0, line.Length);
+
+        lines.push_back(std::move(line));
+    };
+
+    std::size_t line_start = 0;
+    for (std::size_t i = 0; i < string.getSize(); i++) {
+        if(string[i] != '\n')
+            continue;
+
+        Emit(line_start, i, true);
+        line_start = i + 1;
+    }
+
+    // The text always ends with a line, empty after a final line break. Before the end,
+    // the characters given end with the line break of their last line
+    if(end == m_Text.getSize())
+        Emit(line_start, string.getSize(), false);
+
+    m_Lines.edit(first, last, [&](std::vector<Line> &replaced) {
+        replaced = std::move(lines);
+    });
+
+    m_BoundsNeedUpdate = true;
+}
+
+void EditableRichText::relayout(Line& line, std::size_t line_start, std::size_t first, std::size_t last, std::size_t begin, std::size_t end){
+    const unsigned int size = m_CharacterSize;
+    std::vector<Run> &line_runs = line.Runs;
+
+    // The runs before 'first' are untouched, the new ones continue from the pen position of the previous run
+    float x = 0.f;
+    const ColorFont *prev_font = nullptr;
+    std::uint32_t prev_char = 0;
+    if(first){
+        const Run &prev = line_runs[first - 1];
+        x = prev.Text.getPosition().x + prev.Advance;
+        prev_font = prev.Text.getFont();
+        prev_char = prev.Text.getString()[prev.Length - 1];
+    }
+
+    std::vector<Run> runs;
+    sf::String string = m_Text.substring(line_start + begin, end - begin);
+
+    auto Emit = [&](std::size_t start, std::size_t length, const ColorFont &font) {
+        Run run;
+        run.Start = begin + start;
+        run.Length = length;
+        run.Text = ColorText(string.substring(start, length), font, size);
+        run.Text.setFillColor(m_FillColor);
+        run.Advance = run.Text.findCharacterPos(length).x;
+
+        // Kerning only applies between characters of the same font
+        if(prev_font == &font)
+            x += font.getKerning(prev_char, string[start], size);
+
+        run.Text.setPosition(x, 0.f);
+        x += run.Advance;
+
+        prev_font = &font;
+        prev_char = string[start + length - 1];
+
+        runs.push_back(std::move(run));
+    };
+
+    std::size_t run_start = 0;
+    const ColorFont *run_font = nullptr;
+    std::size_t i = 0;
+    for (;;) {
+        for (; i < string.getSize(); i++) {
+            const ColorFont *font = m_Font->findFontForGlyph(string[i]);
+
+            if(run_font && (font != run_font || i - run_start == MaxRunLength)){
+                Emit(run_start, i - run_start, *run_font);
+                run_start = i;
+            }
+
+            run_font = font;
+        }
+
+        // Edits leave short runs behind, the last one takes the next run in while both fit in one
+        if(run_font && last < line_runs.size() && line_runs[last].Text.getFont() == run_font && i - run_start + line_runs[last].Length <= MaxRunLength){
+            string += line_runs[last].Text.getString();
+            end += line_runs[last].Length;
+            last++;
+            continue;
+        }
+
+        break;
+    }
+
+    if(run_font)
+        Emit(run_start, string.getSize() - run_start, *run_font);
+
+    // The following runs of the line keep their geometry, they are just moved by the width and length differences
+    if(last < line_runs.size()){
+        Run &next = line_runs[last];
+
+        float next_x = x;
+        if(prev_font == next.Text.getFont())
+            next_x += prev_font->getKerning(prev_char, next.Text.getString()[0], size);
+
+        float dx = next_x - next.Text.getPosition().x;
+        std::ptrdiff_t shift = static_cast<std::ptrdiff_t>(end) - static_cast<std::ptrdiff_t>(next.Start);
+
+        for (std::size_t r = last; r < line_runs.size(); r++) {
+            line_runs[r].Start += shift;
+            line_runs[r].Text.move(dx, 0.f);
+        }
+    }
+
+    line_runs.erase(line_runs.begin() + first, line_runs.begin() + last);
+    line_runs.insert(line_runs.begin() + first, std::make_move_iterator(runs.begin()), std::make_move_iterator(runs.end()));
+
+    m_BoundsNeedUpdate = true;
+}
+
+std::size_t EditableRichText::findRun(const Line &line, std::size_t index){
+    auto it = std::upper_bound(line.Runs.begin(), line.Runs.end(), index, [](std::size_t index, const Run &run){
+        return index < run.Start;
+    });
+
+    return it == line.Runs.begin() ? 0 : (it - line.Runs.begin()) - 1;
+}
+
+void EditableRichText::draw(sf::RenderTarget& target, sf::RenderStates states) const{
+    states.transform *= getTransform();
+
+    m_Lines.forEach([&](const Line &line, std::size_t row) {
+        sf::RenderStates line_states = states;
+        line_states.transform.translate(0.f, m_LineSpacing * row);
+
+        for (const auto &run : line.Runs)
+            target.draw(run.Text, line_states);
+    });
+}
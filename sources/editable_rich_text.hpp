@@ -0,0 +1,202 @@
+#pragma once
+
+#include "rich_text.hpp"
+#include <functional>
+#include <memory>
+
+// Text storage made of spans of two append-only buffers, edits never move the existing characters.
+// Pieces live in a treap ordered by position where each node knows the length of its subtree, so
+// finding, cutting and joining pieces is logarithmic in the number of pieces.
+class PieceTable {
+	struct Piece {
+		bool Added;
+		std::size_t Start;
+		std::size_t Length;
+	};
+
+	struct Node {
+		Piece Value;
+		std::uint32_t Priority = 0;
+		// Characters in this subtree
+		std::size_t Length = 0;
+		std::unique_ptr<Node> Left;
+		std::unique_ptr<Node> Right;
+	};
+
+	using NodePtr = std::unique_ptr<Node>;
+
+	std::basic_string<sf::Uint32> m_Original;
+	std::basic_string<sf::Uint32> m_Added;
+	NodePtr m_Root;
+	std::size_t m_Size = 0;
+	std::uint32_t m_Seed = 0x9E3779B9;
+public:
+	PieceTable() = default;
+
+	PieceTable(const PieceTable &other);
+
+	PieceTable(PieceTable &&other) = default;
+
+	PieceTable &operator=(const PieceTable &other);
+
+	PieceTable &operator=(PieceTable &&other) = default;
+
+	void assign(const sf::String &string);
+
+	void insert(std::size_t index, const sf::String &string);
+
+	void erase(std::size_t index, std::size_t count);
+
+	std::size_t getSize()const;
+
+	sf::String substring(std::size_t index, std::size_t count)const;
+private:
+	NodePtr makeNode(const Piece &piece);
+
+	static NodePtr clone(const Node *node);
+
+	static void update(Node &node);
+
+	// Cuts the tree after its first 'index' characters, splitting the piece that straddles them
+	void split(NodePtr node, std::size_t index, NodePtr &left, NodePtr &right);
+
+	static NodePtr merge(NodePtr left, NodePtr right);
+
+	// Appends the characters [index, index + count) of the subtree, 'index' relative to its start
+	void collect(const Node *node, std::size_t index, std::size_t &count, std::basic_string<sf::Uint32> &result)const;
+};
+
+// Editable rich text, only the runs touched by an edit get their geometry regenerated.
+// Runs are kept per line, split by font and capped in length, so an edit rebuilds a bounded
+// amount of vertices whatever the document length. Only the following runs of the edited line
+// are moved, the lines below are drawn at their row and their starts are summed from the lengths.
+class EditableRichText: public sf::Drawable, public sf::Transformable{
+	static constexpr std::size_t MaxRunLength = 64;
+
+	struct Run {
+		// Relative to the start of the line
+		std::size_t Start = 0;
+		std::size_t Length = 0;
+		// Pen position after the last character, relative to the run origin
+		float Advance = 0.f;
+		ColorText Text;
+	};
+
+	struct Line {
+		// Characters of the line, without the line break ending it
+		std::size_t Length = 0;
+		bool Break = false;
+		std::vector<Run> Runs;
+	};
+
+	// Lines in a treap ordered by row where each node knows the lines and characters of its subtree,
+	// so finding a line by row or by character and replacing lines is logarithmic in the line count
+	class LineTable {
+		struct Node {
+			Line Value;
+			std::uint32_t Priority = 0;
+			// Lines and characters, line breaks included, in this subtree
+			std::size_t Count = 0;
+			std::size_t Length = 0;
+			std::unique_ptr<Node> Left;
+			std::unique_ptr<Node> Right;
+		};
+
+		using NodePtr = std::unique_ptr<Node>;
+
+		NodePtr m_Root;
+		std::uint32_t m_Seed = 0x9E3779B9;
+	public:
+		LineTable() = default;
+
+		LineTable(const LineTable &other);
+
+		LineTable(LineTable &&other) = default;
+
+		LineTable &operator=(const LineTable &other);
+
+		LineTable &operator=(LineTable &&other) = default;
+
+		void clear();
+
+		std::size_t getCount()const;
+
+		const Line &get(std::size_t line)const;
+
+		// Characters before the line
+		std::size_t getStart(std::size_t line)const;
+
+		// Line holding the character at 'index' and its start, the last line for the end position
+		std::size_t find(std::size_t index, std::size_t &start)const;
+
+		// Takes the lines [first, last) out, lets 'edit' change them and puts the result in their place
+		void edit(std::size_t first, std::size_t last, const std::function<void(std::vector<Line>&)> &edit);
+
+		// Calls 'visit' with every line and its row, in order
+		void forEach(const std::function<void(const Line&, std::size_t)> &visit)const;
+
+		void forEach(const std::function<void(Line&, std::size_t)> &visit);
+	private:
+		NodePtr makeNode(Line &&line);
+
+		static NodePtr clone(const Node *node);
+
+		static void update(Node &node);
+
+		// Cuts the tree after its first 'count' lines
+		static void split(NodePtr node, std::size_t count, NodePtr &left, NodePtr &right);
+
+		static NodePtr merge(NodePtr left, NodePtr right);
+
+		// Moves the lines of the subtree out, in order
+		static void collect(NodePtr node, std::vector<Line> &lines);
+	};
+
+	PieceTable m_Text;
+	LineTable m_Lines;
+	const RichFont *m_Font = nullptr;
+	int m_CharacterSize = 0;
+	float m_LineSpacing = 0.f;
+	sf::Color m_FillColor = sf::Color::White;
+	mutable sf::FloatRect m_Bounds;
+	mutable bool m_BoundsNeedUpdate = false;
+public:
+	void setString(const sf::String &string);
+
+	sf::String getString()const;
+
+	std::size_t getSize()const;
+
+	void insert(std::size_t index, const sf::String &string);
+
+	void erase(std::size_t index, std::size_t count);
+
+	void replace(std::size_t index, std::size_t count, const sf::String &string);
+
+	void setCharacterSize(int size);
+
+	void setRichFont(const RichFont &font);
+
+	void setFillColor(const sf::Color &color);
+
+	sf::FloatRect getLocalBounds()const;
+
+	sf::Vector2f findCharacterPos(std::size_t index)const;
+
+	std::size_t findCharacterIndex(sf::Vector2f point)const;
+private:
+	bool drawn()const;
+
+	void rebuild();
+
+	// Replaces the lines [first, last) by the ones the characters [begin, end) of the text are made of
+	void rebuildLines(std::size_t first, std::size_t last, std::size_t begin, std::size_t end);
+
+	// Re-segments the characters [begin, end) of a line starting at 'line_start', relative to it, replacing its runs [first, last)
+	void relayout(Line &line, std::size_t line_start, std::size_t first, std::size_t last, std::size_t begin, std::size_t end);
+
+	// Index of the run holding the character at 'index' of the line, the last run for the end position
+	static std::size_t findRun(const Line &line, std::size_t index);
+
+	void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
+};
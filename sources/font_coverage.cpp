@@ -0,0 +1,233 @@
+#include "font_coverage.hpp"
+#include <bsl/log.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+DEFINE_LOG_CATEGORY(FontCoverage)
+
+namespace {
+	constexpr char s_Magic[4] = {'R', 'T', 'F', 'C'};
+	// 2: the stamp hashes the whole file instead of samples of it. 3: no metrics
+	constexpr std::uint32_t s_Version = 3;
+
+	// Font files are read in blocks of that size to be hashed
+	constexpr std::size_t s_HashBlockSize = 64 * 1024;
+
+	// Bounds of a well formed manifest, anything past them is garbage
+	constexpr std::uint32_t s_MaxRanges = 0x110000;
+	constexpr std::uint32_t s_MaxCodePoint = 0x10FFFF;
+
+	void HashBytes(std::uint64_t &hash, const void *data, std::size_t size){
+		const unsigned char *bytes = static_cast<const unsigned char*>(data);
+
+		// FNV-1a
+		for (std::size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+	}
+
+	std::uint64_t HashStart(std::uint64_t size){
+		std::uint64_t hash = 0xcbf29ce484222325ull;
+		HashBytes(hash, &size, sizeof(size));
+		return hash;
+	}
+
+	template<typename Type>
+	void Write(std::ostream &stream, const Type &value){
+		stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	template<typename Type>
+	bool Read(std::istream &stream, Type &value){
+		return static_cast<bool>(stream.read(reinterpret_cast<char*>(&value), sizeof(value)));
+	}
+}
+
+bool FontFileStamp::operator==(const FontFileStamp& other)const{
+	return Size == other.Size && ModifiedTime == other.ModifiedTime && Hash == other.Hash;
+}
+
+bool FontFileStamp::operator!=(const FontFileStamp& other)const{
+	return !(*this == other);
+}
+
+std::optional<FontFileStamp> FontFileStamp::fromFile(const std::string& filepath, const FontFileStamp *known){
+	std::error_code error;
+
+	const auto size = std::filesystem::file_size(filepath, error);
+	if(error)
+		return std::nullopt;
+
+	const auto modified = std::filesystem::last_write_time(filepath, error);
+	if(error)
+		return std::nullopt;
+
+	FontFileStamp stamp;
+	stamp.Size = size;
+	stamp.ModifiedTime = static_cast<std::int64_t>(modified.time_since_epoch().count());
+
+	// Untouched since the known stamp was taken, the file isn't read again
+	if (known && known->Size == stamp.Size && known->ModifiedTime == stamp.ModifiedTime) {
+		stamp.Hash = known->Hash;
+		return stamp;
+	}
+
+	RICH_TEXT_TRACE_ZONE_ARG("FontFileStamp::hash", "bytes", stamp.Size);
+
+	std::ifstream file(filepath, std::ios::binary);
+	if(!file)
+		return std::nullopt;
+
+	std::vector<char> block(s_HashBlockSize);
+	std::uint64_t read = 0;
+	stamp.Hash = HashStart(stamp.Size);
+
+	while (file.read(block.data(), block.size()) || file.gcount()) {
+		const std::size_t count = static_cast<std::size_t>(file.gcount());
+		HashBytes(stamp.Hash, block.data(), count);
+		read += count;
+	}
+
+	// Changed while being read, the hash names no content
+	if(read != stamp.Size)
+		return std::nullopt;
+
+	return stamp;
+}
+
+FontFileStamp FontFileStamp::fromMemory(const void* data, std::size_t size){
+	const char *bytes = static_cast<const char*>(data);
+
+	FontFileStamp stamp;
+	stamp.Size = size;
+	stamp.Hash = HashStart(stamp.Size);
+	HashBytes(stamp.Hash, bytes, size);
+
+	return stamp;
+}
+
+bool FontCoverage::contains(std::uint32_t codepoint)const{
+	auto it = std::upper_bound(m_Ranges.begin(), m_Ranges.end(), codepoint, [](std::uint32_t codepoint, const FontCoverageRange &range) {
+		return codepoint < range.First;
+	});
+
+	return it != m_Ranges.begin() && codepoint <= std::prev(it)->Last;
+}
+
+const std::vector<FontCoverageRange> &FontCoverage::getRanges()const{
+	return m_Ranges;
+}
+
+const FontFileStamp &FontCoverage::getStamp()const{
+	return m_Stamp;
+}
+
+bool FontCoverage::saveToFile(const std::string& manifest_path)const{
+	// Written aside and renamed, so a concurrent reader never sees half a manifest. The name is
+	// unique to this writer, processes saving the same manifest at once don't write into one file
+	std::random_device random;
+	const std::string temporary_path = manifest_path + "." + std::to_string(static_cast<std::uint64_t>(random()) << 32 | random()) + ".tmp";
+
+	std::error_code error;
+	{
+		std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+
+		if (!file) {
+			LogFontCoverage(Error, "Can't write coverage manifest '%'", manifest_path);
+			return false;
+		}
+
+		file.write(s_Magic, sizeof(s_Magic));
+		Write(file, s_Version);
+		Write(file, m_Stamp.Size);
+		Write(file, m_Stamp.ModifiedTime);
+		Write(file, m_Stamp.Hash);
+
+		Write(file, static_cast<std::uint32_t>(m_Ranges.size()));
+		for (const auto &range : m_Ranges) {
+			Write(file, range.First);
+			Write(file, range.Last);
+		}
+
+		file.close();
+
+		if (!file) {
+			LogFontCoverage(Error, "Can't write coverage manifest '%'", manifest_path);
+			std::filesystem::remove(temporary_path, error);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(temporary_path, manifest_path, error);
+
+	if (error) {
+		LogFontCoverage(Error, "Can't replace coverage manifest '%': %", manifest_path, error.message());
+		std::filesystem::remove(temporary_path, error);
+		return false;
+	}
+
+	return true;
+}
+
+FontCoverage FontCoverage::build(const ColorFont& font, const FontFileStamp& stamp){
+	RICH_TEXT_TRACE_ZONE("FontCoverage::build");
+
+	FontCoverage coverage;
+	coverage.m_Stamp = stamp;
+
+	// Sorted and disjoint already, anything past Unicode would only make the manifest malformed
+	for (const auto &range : font.getCodePointRanges()) {
+		if(range.first > s_MaxCodePoint)
+			break;
+
+		coverage.m_Ranges.push_back({range.first, std::min(range.second, s_MaxCodePoint)});
+	}
+
+	return coverage;
+}
+
+std::optional<FontCoverage> FontCoverage::loadFromFile(const std::string& manifest_path, const std::string& filepath){
+	std::ifstream file(manifest_path, std::ios::binary);
+
+	// No manifest yet is the usual first run, not an error
+	if(!file)
+		return std::nullopt;
+
+	char magic[sizeof(s_Magic)] = {};
+	std::uint32_t version = 0;
+	FontCoverage coverage;
+
+	if(!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), s_Magic) || !Read(file, version) || version != s_Version)
+		return std::nullopt;
+
+	if(!Read(file, coverage.m_Stamp.Size) || !Read(file, coverage.m_Stamp.ModifiedTime) || !Read(file, coverage.m_Stamp.Hash))
+		return std::nullopt;
+
+	std::uint32_t range_count = 0;
+	if(!Read(file, range_count) || range_count > s_MaxRanges)
+		return std::nullopt;
+
+	coverage.m_Ranges.resize(range_count);
+	for (std::size_t i = 0; i < coverage.m_Ranges.size(); i++) {
+		FontCoverageRange &range = coverage.m_Ranges[i];
+
+		if(!Read(file, range.First) || !Read(file, range.Last))
+			return std::nullopt;
+
+		// contains() binary searches the ranges, they must be sorted and disjoint
+		if(range.First > range.Last || range.Last > s_MaxCodePoint || (i && range.First <= coverage.m_Ranges[i - 1].Last)){
+			LogFontCoverage(Error, "Coverage manifest '%' has malformed ranges", manifest_path);
+			return std::nullopt;
+		}
+	}
+
+	// Stale when the font file was replaced or touched since, the stored hash is reused otherwise
+	std::optional<FontFileStamp> stamp = FontFileStamp::fromFile(filepath, &coverage.m_Stamp);
+	if(!stamp || *stamp != coverage.m_Stamp)
+		return std::nullopt;
+
+	return coverage;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "color_font.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct FontCoverageRange {
+	// Inclusive
+	std::uint32_t First = 0;
+	std::uint32_t Last = 0;
+};
+
+// Identifies the content of a font file: size, modification time and a hash of the whole content.
+// The hash alone names the content, wherever it was loaded from. Hashing reads all of the file, so
+// a stamp is taken once and kept in the coverage manifest, size and modification time tell when it is stale
+struct FontFileStamp {
+	std::uint64_t Size = 0;
+	std::int64_t ModifiedTime = 0;
+	std::uint64_t Hash = 0;
+
+	bool operator==(const FontFileStamp &other)const;
+
+	bool operator!=(const FontFileStamp &other)const;
+
+	// With a 'known' stamp of the same size and modification time, its hash is reused instead of reading the file
+	static std::optional<FontFileStamp> fromFile(const std::string &filepath, const FontFileStamp *known = nullptr);
+
+	// Same size and hash as fromFile gives for a file with that content, no modification time
+	static FontFileStamp fromMemory(const void *data, std::size_t size);
+};
+
+// Code points a font file covers, stored in a small binary manifest so a fallback chain can
+// resolve glyphs to fonts before their faces are opened. A manifest only
+// loads when the stamp of the font file still matches, it is a cache local to the machine.
+class FontCoverage {
+	FontFileStamp m_Stamp;
+	std::vector<FontCoverageRange> m_Ranges;
+public:
+	bool contains(std::uint32_t codepoint)const;
+
+	const std::vector<FontCoverageRange> &getRanges()const;
+
+	const FontFileStamp &getStamp()const;
+
+	bool saveToFile(const std::string &manifest_path)const;
+
+	// Walks the charmap of an opened font, 'stamp' is the one of the file it was opened from
+	static FontCoverage build(const ColorFont &font, const FontFileStamp &stamp);
+
+	// Fails when the manifest is missing, malformed or doesn't match the font file anymore.
+	// Ranges must be sorted, disjoint and not past U+10FFFF for a manifest to be well formed
+	static std::optional<FontCoverage> loadFromFile(const std::string &manifest_path, const std::string &filepath);
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <SFML/Graphics/Glyph.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+
+// Same quad as ColorText produces for an upright glyph, padded by a pixel on each side so the
+// filtering reads the transparent border of the glyph. Written in place, the caller owns the 6 vertices.
+
+// Only moves the quad and its texture coordinates, the vertex colors are left as they are
+inline void PlaceGlyphQuad(sf::Vertex *vertices, sf::Vector2f position, const sf::Glyph &glyph){
+	float padding = 1.0;
+
+	float left   = position.x + glyph.bounds.left - padding;
+	float top    = position.y + glyph.bounds.top - padding;
+	float right  = position.x + glyph.bounds.left + glyph.bounds.width + padding;
+	float bottom = position.y + glyph.bounds.top  + glyph.bounds.height + padding;
+
+	float u_padding = glyph.bounds.width  > 0 ? padding * glyph.textureRect.width  / glyph.bounds.width  : padding;
+	float v_padding = glyph.bounds.height > 0 ? padding * glyph.textureRect.height / glyph.bounds.height : padding;
+
+	float u1 = static_cast<float>(glyph.textureRect.left) - u_padding;
+	float v1 = static_cast<float>(glyph.textureRect.top) - v_padding;
+	float u2 = static_cast<float>(glyph.textureRect.left + glyph.textureRect.width) + u_padding;
+	float v2 = static_cast<float>(glyph.textureRect.top  + glyph.textureRect.height) + v_padding;
+
+	vertices[0].position = {left,  top};    vertices[0].texCoords = {u1, v1};
+	vertices[1].position = {right, top};    vertices[1].texCoords = {u2, v1};
+	vertices[2].position = {left,  bottom}; vertices[2].texCoords = {u1, v2};
+	vertices[3].position = {left,  bottom}; vertices[3].texCoords = {u1, v2};
+	vertices[4].position = {right, top};    vertices[4].texCoords = {u2, v1};
+	vertices[5].position = {right, bottom}; vertices[5].texCoords = {u2, v2};
+}
+
+inline void WriteGlyphQuad(sf::Vertex *vertices, sf::Vector2f position, const sf::Color &color, const sf::Glyph &glyph){
+	PlaceGlyphQuad(vertices, position, glyph);
+
+	for(int i = 0; i < 6; i++)
+		vertices[i].color = color;
+}
@@ -0,0 +1,129 @@
+#include "label_atlas.hpp"
+#include "rich_text_trace.hpp"
+#include <bsl/log.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+
+DEFINE_LOG_CATEGORY(LabelAtlas)
+
+// Color is weighted by its alpha once, when drawn into the atlas, alpha accumulates like on screen
+const sf::BlendMode LabelAtlas::PremultipliedBlend(
+	sf::BlendMode::SrcAlpha, sf::BlendMode::OneMinusSrcAlpha, sf::BlendMode::Add,
+	sf::BlendMode::One, sf::BlendMode::OneMinusSrcAlpha, sf::BlendMode::Add
+);
+
+LabelAtlas::LabelAtlas(unsigned int width, unsigned int height){
+	if(!m_Texture.create(width, height))
+		LogLabelAtlas(Error, "Can't create a % by % label atlas", width, height);
+
+	m_Texture.clear(sf::Color::Transparent);
+	m_Texture.display();
+}
+
+bool LabelAtlas::allocate(sf::Vector2i size, LabelAtlasRegion& region){
+	const sf::Vector2u atlas_size = m_Texture.getSize();
+
+	// One pixel of spacing, so regions never sample each other
+	size += sf::Vector2i(1, 1);
+
+	if(size.x > static_cast<int>(atlas_size.x) || size.y > static_cast<int>(atlas_size.y))
+		return false;
+
+	auto Place = [&](std::size_t index) {
+		Shelf &shelf = m_Shelves[index];
+
+		region.Rect = sf::IntRect(shelf.Width, shelf.Top, size.x - 1, size.y - 1);
+		region.Shelf = index;
+		region.Generation = shelf.Generation;
+
+		shelf.Width += size.x;
+		shelf.LastUse = ++m_Uses;
+	};
+
+	for (std::size_t i = 0; i < m_Shelves.size(); i++) {
+		const Shelf &shelf = m_Shelves[i];
+
+		// Don't waste a tall shelf on a short region
+		if(size.y > shelf.Height || size.y < shelf.Height / 2 || shelf.Width + size.x > static_cast<int>(atlas_size.x))
+			continue;
+
+		Place(i);
+		return true;
+	}
+
+	if (m_Bottom + size.y <= static_cast<int>(atlas_size.y)) {
+		m_Shelves.push_back({m_Bottom, size.y, 0, m_NextGeneration++, 0});
+		m_Bottom += size.y;
+
+		Place(m_Shelves.size() - 1);
+		return true;
+	}
+
+	// Full: the least recently drawn shelf that can hold the region is emptied for it, the labels
+	// that were baked there bake again the next time they are drawn
+	std::size_t victim = m_Shelves.size();
+	for (std::size_t i = 0; i < m_Shelves.size(); i++) {
+		if(size.y > m_Shelves[i].Height)
+			continue;
+
+		if(victim == m_Shelves.size() || m_Shelves[i].LastUse < m_Shelves[victim].LastUse)
+			victim = i;
+	}
+
+	if(victim == m_Shelves.size())
+		return false;
+
+	RICH_TEXT_TRACE_ZONE("LabelAtlas::evict");
+
+	m_Shelves[victim].Width = 0;
+	m_Shelves[victim].Generation = m_NextGeneration++;
+
+	Place(victim);
+	return true;
+}
+
+bool LabelAtlas::isValid(const LabelAtlasRegion& region)const{
+	return region.Generation && region.Shelf < m_Shelves.size() && m_Shelves[region.Shelf].Generation == region.Generation;
+}
+
+void LabelAtlas::touch(const LabelAtlasRegion& region){
+	if(isValid(region))
+		m_Shelves[region.Shelf].LastUse = ++m_Uses;
+}
+
+sf::RenderTarget& LabelAtlas::beginRegion(const sf::IntRect& rect){
+	float left = static_cast<float>(rect.left);
+	float top = static_cast<float>(rect.top);
+	float right = static_cast<float>(rect.left + rect.width);
+	float bottom = static_cast<float>(rect.top + rect.height);
+
+	const sf::Vertex clear[] = {
+		sf::Vertex({left,  top},    sf::Color::Transparent),
+		sf::Vertex({right, top},    sf::Color::Transparent),
+		sf::Vertex({left,  bottom}, sf::Color::Transparent),
+		sf::Vertex({left,  bottom}, sf::Color::Transparent),
+		sf::Vertex({right, top},    sf::Color::Transparent),
+		sf::Vertex({right, bottom}, sf::Color::Transparent),
+	};
+
+	// A region may be reused, its previous contents are overwritten rather than blended with
+	m_Texture.draw(clear, 6, sf::PrimitiveType::Triangles, sf::RenderStates(sf::BlendNone));
+
+	return m_Texture;
+}
+
+void LabelAtlas::display(){
+	m_Texture.display();
+}
+
+void LabelAtlas::reset(){
+	// Shelves created from now on get new generations, no region survives
+	m_Shelves.clear();
+	m_Bottom = 0;
+
+	m_Texture.clear(sf::Color::Transparent);
+	m_Texture.display();
+}
+
+const sf::Texture& LabelAtlas::getTexture()const{
+	return m_Texture.getTexture();
+}
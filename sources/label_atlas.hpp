@@ -0,0 +1,60 @@
+#pragma once
+
+#include <SFML/Graphics/RenderTexture.hpp>
+#include <cstdint>
+#include <vector>
+
+struct LabelAtlasRegion {
+	sf::IntRect Rect;
+	std::size_t Shelf = 0;
+	// Generation of the shelf when the region was allocated, zero for no region
+	std::uint64_t Generation = 0;
+};
+
+// Render texture shared by baked labels, regions are packed on shelves. Regions can't be freed one
+// by one: once full the least recently drawn shelf is emptied and its generation changes, which tells
+// the labels baked into it to bake again
+class LabelAtlas {
+	struct Shelf {
+		int Top = 0;
+		int Height = 0;
+		int Width = 0;
+		std::uint64_t Generation = 0;
+		// Value of m_Uses when a region of the shelf was last drawn
+		std::uint64_t LastUse = 0;
+	};
+
+	sf::RenderTexture m_Texture;
+	std::vector<Shelf> m_Shelves;
+	int m_Bottom = 0;
+	std::uint64_t m_NextGeneration = 1;
+	std::uint64_t m_Uses = 0;
+public:
+	LabelAtlas(unsigned int width, unsigned int height);
+
+	LabelAtlas(const LabelAtlas &) = delete;
+
+	LabelAtlas &operator=(const LabelAtlas &) = delete;
+
+	// Evicts the least recently used shelf tall enough when the atlas is full. Returns false when no
+	// shelf can take 'size', the label is drawn without baking then
+	bool allocate(sf::Vector2i size, LabelAtlasRegion &region);
+
+	// False once the shelf of the region was evicted or the atlas reset
+	bool isValid(const LabelAtlasRegion &region)const;
+
+	// Marks the region as drawn, the shelves drawn last are evicted last
+	void touch(const LabelAtlasRegion &region);
+
+	// Clears 'rect' and returns the target to draw its new contents into, call display() once done.
+	// Contents should be drawn with PremultipliedBlend, baked regions hold premultiplied colors
+	sf::RenderTarget &beginRegion(const sf::IntRect &rect);
+
+	void display();
+
+	void reset();
+
+	const sf::Texture &getTexture()const;
+
+	static const sf::BlendMode PremultipliedBlend;
+};
@@ -0,0 +1,206 @@
+#include "numeric_label.hpp"
+#include "glyph_quad.hpp"
+#include <SFML/Graphics/RenderTarget.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+NumericLabel::NumericLabel(std::size_t max_characters):
+	m_MaxCharacters(max_characters),
+	m_Vertices(max_characters * 6),
+	m_CellQuads(CharsetSize * 6)
+{
+	m_Text.reserve(max_characters);
+}
+
+void NumericLabel::setFont(const ColorFont& font){
+	if(&font == m_Font)
+		return;
+
+	m_Font = &font;
+
+	preload();
+}
+
+void NumericLabel::setCharacterSize(unsigned int size){
+	if(size == m_CharacterSize)
+		return;
+
+	m_CharacterSize = size;
+
+	preload();
+}
+
+void NumericLabel::setFillColor(const sf::Color& color){
+	m_FillColor = color;
+
+	// Color fonts keep their own colors, like in ColorText
+	sf::Color vertex_color = m_Font && m_Font->isColorEmojiFont() ? sf::Color::White : color;
+
+	for(auto &vertex: m_Vertices)
+		vertex.color = vertex_color;
+}
+
+void NumericLabel::setTabular(bool tabular){
+	if(tabular == m_Tabular)
+		return;
+
+	m_Tabular = tabular;
+
+	layout();
+}
+
+void NumericLabel::setValue(long long value){
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%lld", value);
+
+	setText(buffer);
+}
+
+void NumericLabel::setValue(double value, int decimals){
+	char buffer[64];
+	std::snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+
+	setText(buffer);
+}
+
+void NumericLabel::setText(const char* text){
+	std::size_t length = std::min(std::strlen(text), m_MaxCharacters);
+
+	if(m_Text.compare(0, std::string::npos, text, length) == 0)
+		return;
+
+	// Capacity was reserved for m_MaxCharacters, assigning doesn't allocate
+	m_Text.assign(text, length);
+
+	layout();
+}
+
+float NumericLabel::getWidth()const{
+	return m_Width;
+}
+
+bool NumericLabel::drawn()const{
+	return m_Font && m_CharacterSize;
+}
+
+std::size_t NumericLabel::findInCharset(char character){
+	static const std::array<unsigned char, 256> indices = []() {
+		std::array<unsigned char, 256> indices;
+		indices.fill(CharsetSize);
+
+		for (std::size_t i = 0; i < CharsetSize; i++)
+			indices[static_cast<unsigned char>(Charset[i])] = static_cast<unsigned char>(i);
+
+		return indices;
+	}();
+
+	return indices[static_cast<unsigned char>(character)];
+}
+
+void NumericLabel::preload(){
+	if(!drawn())
+		return;
+
+	loadGlyphs();
+
+	setFillColor(m_FillColor);
+
+	layout();
+}
+
+void NumericLabel::loadGlyphs()const{
+	m_CellAdvance = 0.f;
+
+	for (std::size_t i = 0; i < CharsetSize; i++) {
+		m_Glyphs[i] = m_Font->getGlyph(static_cast<unsigned char>(Charset[i]), m_CharacterSize, false);
+		m_CellAdvance = std::max(m_CellAdvance, m_Glyphs[i].advance);
+	}
+
+	const float y = static_cast<float>(m_CharacterSize);
+
+	for(std::size_t i = 0; i < CharsetSize; i++)
+		PlaceGlyphQuad(&m_CellQuads[i * 6], sf::Vector2f((m_CellAdvance - m_Glyphs[i].advance) / 2.f, y), m_Glyphs[i]);
+
+	// After the lookups, the first glyph loaded into a page creates it
+	m_PageId = m_Font->getPageId(m_CharacterSize);
+}
+
+void NumericLabel::layout()const{
+	m_Count = 0;
+	m_Width = 0.f;
+
+	if(!drawn())
+		return;
+
+	if (m_Tabular) {
+		layoutTabular();
+		return;
+	}
+
+	float x = 0.f;
+	const float y = static_cast<float>(m_CharacterSize);
+	char prev_char = 0;
+
+	for (char character : m_Text) {
+		const std::size_t index = findInCharset(character);
+
+		if (index == CharsetSize) {
+			x += m_Glyphs[CharsetSize - 1].advance;
+			prev_char = 0;
+			continue;
+		}
+
+		const sf::Glyph &glyph = m_Glyphs[index];
+
+		if(prev_char)
+			x += m_Font->getKerning(prev_char, character, m_CharacterSize);
+
+		if(character != ' ')
+			PlaceGlyphQuad(&m_Vertices[m_Count++ * 6], sf::Vector2f(x, y), glyph);
+		x += glyph.advance;
+
+		prev_char = character;
+	}
+
+	m_Width = x;
+}
+
+void NumericLabel::layoutTabular()const{
+	for (std::size_t i = 0; i < m_Text.size(); i++) {
+		const std::size_t index = findInCharset(m_Text[i]);
+
+		// Blanks just leave their cell empty
+		if(index == CharsetSize || m_Text[i] == ' ')
+			continue;
+
+		const sf::Vertex *quad = &m_CellQuads[index * 6];
+		sf::Vertex *vertices = &m_Vertices[m_Count++ * 6];
+		const float x = m_CellAdvance * i;
+
+		for (std::size_t v = 0; v < 6; v++) {
+			vertices[v].position = sf::Vector2f(quad[v].position.x + x, quad[v].position.y);
+			vertices[v].texCoords = quad[v].texCoords;
+		}
+	}
+
+	m_Width = m_CellAdvance * m_Text.size();
+}
+
+void NumericLabel::draw(sf::RenderTarget& target, sf::RenderStates states) const{
+	if(!m_Count)
+		return;
+
+	// A trimmed page comes back with a new id and other texture rects
+	if (m_Font->getPageId(m_CharacterSize) != m_PageId) {
+		loadGlyphs();
+		layout();
+	}
+
+	states.transform *= getTransform();
+	states.texture = &m_Font->getTexture(m_CharacterSize);
+
+	target.draw(m_Vertices.data(), m_Count * 6, sf::PrimitiveType::Triangles, states);
+	RICH_TEXT_COUNT(RichTextCounters::global(), DrawCalls, 1);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "color_font.hpp"
+#include <SFML/Graphics/Drawable.hpp>
+#include <SFML/Graphics/Transformable.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+#include <string>
+#include <vector>
+
+// Label for values updated every frame: counters, timers, scores. The glyphs it can show are loaded once,
+// then a new value only rewrites the positions and texture coordinates of a fixed amount of quads,
+// without allocation. In tabular mode the quads of the charset are laid out once per font and size,
+// a new value only copies them into their cells
+class NumericLabel: public sf::Drawable, public sf::Transformable{
+	// Characters a value can be made of, anything else is shown as a blank
+	static constexpr char Charset[] = "0123456789+-.,:% ";
+	static constexpr std::size_t CharsetSize = sizeof(Charset) - 1;
+
+	std::size_t m_MaxCharacters = 0;
+	mutable std::vector<sf::Vertex> m_Vertices;
+	mutable std::size_t m_Count = 0;
+	std::string m_Text;
+	mutable float m_Width = 0.f;
+
+	const ColorFont *m_Font = nullptr;
+	unsigned int m_CharacterSize = 0;
+	sf::Color m_FillColor = sf::Color::White;
+	bool m_Tabular = false;
+
+	mutable sf::Glyph m_Glyphs[CharsetSize];
+	// Widest advance of the charset, every character takes a cell that wide in tabular mode
+	mutable float m_CellAdvance = 0.f;
+	// Quad of each charset glyph centered in a cell at the origin, for tabular mode
+	mutable std::vector<sf::Vertex> m_CellQuads;
+	// Page the glyphs' texture rects point into, a ColorFont::trim releasing it makes them stale
+	mutable sf::Uint64 m_PageId = 0;
+public:
+	// Characters past 'max_characters' are not shown
+	NumericLabel(std::size_t max_characters);
+
+	void setFont(const ColorFont &font);
+
+	void setCharacterSize(unsigned int size);
+
+	void setFillColor(const sf::Color &color);
+
+	// Gives all characters the same cell and no kerning, so the label doesn't wobble as the value changes
+	void setTabular(bool tabular);
+
+	void setValue(long long value);
+
+	void setValue(double value, int decimals);
+
+	void setText(const char *text);
+
+	float getWidth()const;
+private:
+	bool drawn()const;
+
+	// Position of the character in the charset, CharsetSize when it isn't in it
+	static std::size_t findInCharset(char character);
+
+	void preload();
+
+	void loadGlyphs()const;
+
+	void layout()const;
+
+	// Copies the prepared cell quads, the characters' positions only depend on their index
+	void layoutTabular()const;
+
+	void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
+};
@@ -1,39 +1,354 @@
 #include "rich_text.hpp"
 #include <bsl/log.hpp>
 #include <SFML/Graphics/RenderTarget.hpp>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
 
 DEFINE_LOG_CATEGORY(RichText)
 
-RichFont::RichFont(std::vector<ColorFont>&& fonts):
-	m_Fonts(std::move(fonts))
-{}
+namespace {
+	void Unite(sf::FloatRect &bounds, const sf::FloatRect &other){
+		if (bounds.width == 0 && bounds.height == 0) {
+			bounds = other;
+		} else {
+			float right = std::max(bounds.left + bounds.width, other.left + other.width);
+			float bottom = std::max(bounds.top + bounds.height, other.top + other.height);
+			bounds.left = std::min(bounds.left, other.left);
+			bounds.top = std::min(bounds.top, other.top);
+			bounds.width = right - bounds.left;
+			bounds.height = bottom - bounds.top;
+		}
+	}
+
+	// Code points laid out as advances or not drawn at all, no fallback has a better glyph for them.
+	// Covers control characters, the spaces ColorText handles itself and values that aren't characters
+	bool IsLayoutOnly(std::uint32_t codepoint){
+		return codepoint < 0x20 || codepoint == ' ' || (codepoint >= 0x7F && codepoint <= 0x9F)
+			|| (codepoint >= 0xD800 && codepoint <= 0xDFFF) || codepoint > 0x10FFFF;
+	}
+}
+
+bool RichFont::FontEntry::load(){
+	const FontState state = State.load(std::memory_order_acquire);
+	if(state != FontState::Unloaded)
+		return state == FontState::Loaded;
+
+	std::lock_guard<std::mutex> lock(Lock);
+
+	// Another thread may have opened it while this one waited
+	if(State.load(std::memory_order_relaxed) != FontState::Unloaded)
+		return State.load(std::memory_order_relaxed) == FontState::Loaded;
+
+	RICH_TEXT_TRACE_ZONE("RichFont::loadFallback");
+
+	// The manifest keeps the content hash, the file isn't read through to get it
+	if (!Font.loadFromFile(Path, Coverage ? Coverage->getStamp().Hash : 0)) {
+		LogRichText(Error, "Can't load font from '%'", Path);
+		State.store(FontState::Failed, std::memory_order_release);
+		return false;
+	}
+
+	State.store(FontState::Loaded, std::memory_order_release);
+
+	// Next run resolves glyphs to this font without opening it. Stamping reads all of the file,
+	// that is not for the thread waiting on a glyph, nor for the entry lock
+	if(!ManifestPath.empty() && !Coverage)
+		ManifestWrite = std::async(std::launch::async, &FontEntry::writeManifest, this);
+
+	return true;
+}
+
+void RichFont::FontEntry::writeManifest(){
+	RICH_TEXT_TRACE_ZONE("RichFont::writeManifest");
+
+	std::optional<FontFileStamp> stamp = FontFileStamp::fromFile(Path);
+
+	if (!stamp) {
+		LogRichText(Error, "Can't stamp font file '%'", Path);
+		return;
+	}
+
+	FontCoverage::build(Font, *stamp).saveToFile(ManifestPath);
+}
+
+void RichFont::FontEntry::waitForManifest(){
+	std::lock_guard<std::mutex> lock(Lock);
+
+	if(ManifestWrite.valid())
+		ManifestWrite.wait();
+}
+
+bool RichFont::FontEntry::isLoaded()const{
+	return State.load(std::memory_order_acquire) == FontState::Loaded;
+}
+
+RichFont::RichFont(std::vector<ColorFont>&& fonts){
+	for (auto &font : fonts) {
+		auto entry = std::make_shared<FontEntry>();
+		entry->Font = std::move(font);
+		entry->State.store(FontState::Loaded, std::memory_order_relaxed);
+		m_Fonts.push_back(std::move(entry));
+	}
+}
+
+RichFont::~RichFont(){
+	for (const auto &preload : m_Preloads)
+		preload.wait();
+}
 
 bool RichFont::valid() const{
 	return m_Fonts.size();
 }
 
+void RichFont::addFallback(const std::string& filepath, const std::string& manifest_path){
+	auto entry = std::make_shared<FontEntry>();
+	entry->Path = filepath;
+	entry->ManifestPath = manifest_path;
+
+	if(!manifest_path.empty())
+		entry->Coverage = FontCoverage::loadFromFile(manifest_path, filepath);
+
+	m_Fonts.push_back(std::move(entry));
+}
+
+std::shared_future<bool> RichFont::preload()const{
+	// Finished preloads have nothing left to wait for
+	m_Preloads.erase(std::remove_if(m_Preloads.begin(), m_Preloads.end(), [](const std::shared_future<bool> &preload) {
+		return preload.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}), m_Preloads.end());
+
+	// The entries are captured rather than this, a RichFont can be moved while it runs
+	std::shared_future<bool> future = std::async(std::launch::async, [entries = m_Fonts]() {
+		bool loaded = true;
+		for (const auto &entry : entries)
+			loaded = entry->load() && loaded;
+
+		return loaded;
+	}).share();
+
+	m_Preloads.push_back(future);
+
+	return future;
+}
+
+void RichFont::flush()const{
+	// Preloads go first, the fonts they open may start manifest writes
+	for (const auto &preload : m_Preloads)
+		preload.wait();
+
+	for (const auto &entry : m_Fonts)
+		entry->waitForManifest();
+}
+
+std::size_t RichFont::getFontCount()const{
+	return m_Fonts.size();
+}
+
+std::size_t RichFont::getLoadedFontCount()const{
+	return std::count_if(m_Fonts.begin(), m_Fonts.end(), [](const std::shared_ptr<FontEntry> &entry) {
+		return entry->isLoaded();
+	});
+}
+
+const FontCoverage *RichFont::getCoverage(std::size_t index)const{
+	if(index >= m_Fonts.size() || !m_Fonts[index]->Coverage)
+		return nullptr;
+
+	return &*m_Fonts[index]->Coverage;
+}
+
 const ColorFont *RichFont::findFontForGlyph(std::uint32_t codepoint) const{
 	if(!m_Fonts.size()){
 		LogRichText(Error, "Using invalid font");
 		return nullptr;
 	}
 
-	for (const auto& font : m_Fonts) {
-		if(font.hasGlyph(codepoint))
-			return &font;
+	// Would open every lazy fallback just to find none has it
+	if(IsLayoutOnly(codepoint))
+		return &m_Fonts.front()->Font;
+
+	// Fallbacks are only opened when every font before them lacks the glyph, and their manifest has it
+	for (const auto& entry : m_Fonts) {
+		if(entry->Coverage && !entry->isLoaded() && !entry->Coverage->contains(codepoint))
+			continue;
+
+		if(entry->load() && entry->Font.hasGlyph(codepoint))
+			return &entry->Font;
+	}
+
+	return &m_Fonts.front()->Font;
+}
+
+RichTextMetrics RichFont::measure(const sf::String& string, int character_size, float *offsets, std::vector<RichTextGlyph> *glyphs, sf::Uint32 style)const{
+	RichTextMetrics metrics;
+
+	if (!valid() || character_size <= 0) {
+		if(offsets)
+			std::fill(offsets, offsets + string.getSize() + 1, 0.f);
+		return metrics;
+	}
+
+	const unsigned int size = character_size;
+	const float baseline = static_cast<float>(size);
+	const bool bold = style & sf::Text::Bold;
+	const float italic_shear = (style & sf::Text::Italic) ? 0.209f : 0.f;
+
+	// Per run state, mirrors ColorText::ensureGeometryUpdate
+	const ColorFont *run_font = nullptr;
+	float run_x = 0.f;
+	float x = 0.f;
+	float y = baseline;
+	float whitespace_width = 0.f;
+	float line_spacing = 0.f;
+	float min_x = 0.f, min_y = 0.f, max_x = 0.f, max_y = 0.f;
+	std::uint32_t prev_char = 0;
+
+	auto Flush = [&]() {
+		if(!run_font)
+			return;
+
+		sf::FloatRect bounds(run_x + min_x, min_y, max_x - min_x, max_y - min_y);
+		Unite(metrics.Bounds, bounds);
+		run_x += bounds.width;
+		run_font = nullptr;
+	};
+
+	for (std::size_t i = 0; i < string.getSize(); ++i) {
+		std::uint32_t character = string[i];
+		const ColorFont *font = findFontForGlyph(character);
+
+		if (font != run_font) {
+			Flush();
+
+			run_font = font;
+			x = 0.f;
+			y = baseline;
+			min_x = min_y = baseline;
+			max_x = max_y = 0.f;
+			prev_char = 0;
+			whitespace_width = font->getGlyphMetrics(L' ', size, bold).advance;
+			line_spacing = font->getLineSpacing(size);
+		}
+
+		if(offsets)
+			offsets[i] = run_x + x;
+
+		if (character == L'\r')
+			continue;
+
+		x += font->getKerning(prev_char, character, size, bold);
+		prev_char = character;
+
+		if (character == L' ' || character == L'\n' || character == L'\t') {
+			min_x = std::min(min_x, x);
+			min_y = std::min(min_y, y);
+
+			switch (character) {
+				case L' ':  x += whitespace_width;     break;
+				case L'\t': x += whitespace_width * 4; break;
+				case L'\n': y += line_spacing; x = 0;  break;
+			}
+
+			max_x = std::max(max_x, x);
+			max_y = std::max(max_y, y);
+			continue;
+		}
+
+		const sf::Glyph &glyph = font->getGlyphMetrics(character, size, bold);
+
+		if(glyphs)
+			glyphs->push_back({font, character, sf::Vector2f(run_x + x, y)});
+
+		min_x = std::min(min_x, x + glyph.bounds.left - italic_shear * (glyph.bounds.top + glyph.bounds.height));
+		max_x = std::max(max_x, x + glyph.bounds.left + glyph.bounds.width - italic_shear * glyph.bounds.top);
+		min_y = std::min(min_y, y + glyph.bounds.top);
+		max_y = std::max(max_y, y + glyph.bounds.top + glyph.bounds.height);
+
+		x += glyph.advance;
+	}
+
+	if(offsets)
+		offsets[string.getSize()] = run_x + x;
+
+	Flush();
+
+	metrics.Advance = run_x;
+
+	return metrics;
+}
+
+ColorFont::MemoryUsage RichFont::getMemoryUsage()const{
+	ColorFont::MemoryUsage total;
+
+	for (const auto &entry : m_Fonts) {
+		if(!entry->isLoaded())
+			continue;
+
+		ColorFont::MemoryUsage usage = entry->Font.getMemoryUsage();
+
+		total.pages += usage.pages;
+		total.textureBytes += usage.textureBytes;
+		total.glyphs += usage.glyphs;
+		total.metrics += usage.metrics;
+		total.meshBytes += usage.meshBytes;
+		total.tableBytes += usage.tableBytes;
+	}
+
+	return total;
+}
+
+RichTextStats RichFont::getStats()const{
+	RichTextStats total;
+
+	for(const auto &entry: m_Fonts){
+		if(entry->isLoaded())
+			total += entry->Font.getStats();
+	}
+
+	return total;
+}
+
+void RichFont::resetStats(){
+	for(auto &entry: m_Fonts){
+		if(entry->isLoaded())
+			entry->Font.resetStats();
+	}
+}
+
+void RichFont::advanceFrame(){
+	for(auto &entry: m_Fonts){
+		if(entry->isLoaded())
+			entry->Font.advanceFrame();
 	}
+}
 
-	return &m_Fonts.front();
+std::size_t RichFont::trim(unsigned int max_idle_frames, std::size_t texture_budget){
+	std::size_t released = 0;
+
+	for(auto &entry: m_Fonts){
+		if(entry->isLoaded())
+			released += entry->Font.trim(max_idle_frames, texture_budget);
+	}
+
+	return released;
 }
 
 RichFont RichFont::loadFromFile(const std::string& filepath){
 	return loadFromFiles({filepath});
 }
 
-RichFont RichFont::loadFromFiles(std::initializer_list<std::string> filepath){
+RichFont RichFont::loadFromFiles(std::initializer_list<std::string> filepath, bool lazy_fallbacks, const std::string &manifest_directory){
 	std::vector<ColorFont> fonts;
+	std::vector<std::string> fallbacks;
 	
 	for (const auto& path: filepath) {
+		// Startup only pays for the primary font
+		if (lazy_fallbacks && fonts.size()) {
+			fallbacks.push_back(path);
+			continue;
+		}
+
 		ColorFont font;
 		if(!font.loadFromFile(path)){
 			LogRichText(Error, "Can't load font from '%'", path);
@@ -43,33 +358,34 @@ RichFont RichFont::loadFromFiles(std::initializer_list<std::string> filepath){
 		fonts.push_back(std::move(font));
 	}
 
-	return RichFont(std::move(fonts));
+	RichFont font(std::move(fonts));
+
+	for (const auto &path: fallbacks) {
+		std::string manifest_path;
+		if(!manifest_directory.empty())
+			manifest_path = (std::filesystem::path(manifest_directory) / std::filesystem::path(path).filename()).string() + ".coverage";
+
+		font.addFallback(path, manifest_path);
+	}
+
+	return font;
 }
 
 sf::FloatRect RichTextLine::getLocalBounds()const{
-    sf::FloatRect bounds;
-    for (const auto& text : m_Texts) {
-        sf::FloatRect localBounds = text.getLocalBounds();
-        sf::Vector2f position = text.getPosition();
-        localBounds.left += position.x;
-        localBounds.top += position.y;
-
-        if (bounds.width == 0 && bounds.height == 0) {
-            bounds = localBounds;
-        } else {
-            bounds.left = std::min(bounds.left, localBounds.left);
-            bounds.top = std::min(bounds.top, localBounds.top);
-            bounds.width = std::max(bounds.left + bounds.width, localBounds.left + localBounds.width) - bounds.left;
-            bounds.height = std::max(bounds.top + bounds.height, localBounds.top + localBounds.height) - bounds.top;
-        }
-    }
-    return bounds;
+    ensureRebuilt();
+
+    return m_Bounds;
 }
 
 void RichTextLine::setString(const sf::String& string){
+    if(string == m_String)
+        return;
+
     m_String = string;
     
-    rebuild();
+    // Kept runs would still carry the effects of the old characters
+    invalidate(RichTextCounter::RebuildString, m_GlyphEffects.empty());
+    m_GlyphEffects.clear();
 }
 
 void RichTextLine::setString(const std::string& string){
@@ -80,43 +396,281 @@ sf::String RichTextLine::getString() const{
     return m_String;
 }
 
+const RichFont *RichTextLine::getRichFont() const{
+    return m_Font;
+}
+
+int RichTextLine::getCharacterSize() const{
+    return m_CharacterSize;
+}
+
+const sf::Color &RichTextLine::getFillColor() const{
+    return m_FillColor;
+}
+
 void RichTextLine::setCharacterSize(int size){
+    if(size == m_CharacterSize)
+        return;
+
     m_CharacterSize = size;
 
-    rebuild();
+    invalidate(RichTextCounter::RebuildSize);
 }
 
 void RichTextLine::setRichFont(const RichFont& font){
+    if(&font == m_Font)
+        return;
+
     m_Font = &font;
 
-    rebuild();
+    invalidate(RichTextCounter::RebuildFont);
 }
 
 void RichTextLine::setFillColor(const sf::Color& color){
+    if(color == m_FillColor)
+        return;
+
+    m_FillColor = color;
+
+    // Colors don't move anything, built runs are recolored in place, including the ones a string change may keep
     for(auto &text: m_Texts)
         text.setFillColor(color);
+
+    m_BakeOutdated = true;
 }
 
 void RichTextLine::setOutlineColor(const sf::Color& color){
+    if(color == m_OutlineColor)
+        return;
+
+    m_OutlineColor = color;
+
     for(auto &text: m_Texts)
         text.setOutlineColor(color);
+
+    m_BakeOutdated = true;
 }
 
 void RichTextLine::setOutlineThickness(float thickness){
-    for(auto &text: m_Texts)
-        text.setOutlineThickness(thickness);
+    if(thickness == m_OutlineThickness)
+        return;
+
+    m_OutlineThickness = thickness;
+
+    invalidate(RichTextCounter::RebuildStyle);
 }
 
 void RichTextLine::setStyle(sf::Text::Style style){
-    for(auto &text: m_Texts)
-        text.setStyle(style);
+    if(style == m_Style)
+        return;
+
+    m_Style = style;
+
+    invalidate(RichTextCounter::RebuildStyle);
 }
 
 bool RichTextLine::drawn() const{
     return m_CharacterSize && m_Font && m_String.getSize();
 }
 
-std::vector<ColorText> RichTextLine::build(const RichFont &rich_font, const sf::String& string, int character_size){
+sf::Vector2f RichTextLine::findCharacterPos(std::size_t index) const{
+    const auto &offsets = characterOffsets();
+
+    index = std::min(index, offsets.size() - 1);
+
+    return getTransform().transformPoint(offsets[index], 0.f);
+}
+
+std::size_t RichTextLine::findCharacterIndex(sf::Vector2f point) const{
+    const auto &offsets = characterOffsets();
+
+    float x = getInverseTransform().transformPoint(point).x;
+
+    auto it = std::lower_bound(offsets.begin(), offsets.end(), x);
+
+    if(it == offsets.end())
+        return offsets.size() - 1;
+
+    // Snap to the closest of the two surrounding caret positions
+    if(it != offsets.begin() && x - *(it - 1) < *it - x)
+        --it;
+
+    return it - offsets.begin();
+}
+
+void RichTextLine::setVisibleCharacterCount(std::size_t count){
+    if(count == m_VisibleCount)
+        return;
+
+    // Only the runs the reveal moved through show a different count, the effects are already in the runs
+    const std::size_t from = std::min(count, m_VisibleCount);
+    const std::size_t to = std::max(count, m_VisibleCount);
+
+    m_VisibleCount = count;
+    m_BakeOutdated = true;
+
+    if(m_NeedsRebuild)
+        return;
+
+    std::size_t start = 0;
+
+    for (auto &text : m_Texts) {
+        if(start >= to)
+            break;
+
+        const std::size_t length = text.getString().getSize();
+
+        if(start + length > from)
+            text.setVisibleCharacterCount(count > start ? count - start : 0);
+
+        start += length;
+    }
+}
+
+void RichTextLine::setCharacterColor(std::size_t index, const sf::Color& color){
+    if(index >= m_String.getSize())
+        return;
+
+    if(m_GlyphEffects.size() < m_String.getSize())
+        m_GlyphEffects.resize(m_String.getSize());
+
+    m_GlyphEffects[index].HasColor = true;
+    m_GlyphEffects[index].Color = color;
+    m_BakeOutdated = true;
+
+    if(m_NeedsRebuild)
+        return;
+
+    if(ColorText *run = findRun(index))
+        run->setCharacterColor(index, color);
+}
+
+void RichTextLine::setCharacterOffset(std::size_t index, sf::Vector2f offset){
+    if(index >= m_String.getSize())
+        return;
+
+    if(m_GlyphEffects.size() < m_String.getSize())
+        m_GlyphEffects.resize(m_String.getSize());
+
+    m_GlyphEffects[index].Offset = offset;
+    m_BakeOutdated = true;
+
+    if(m_NeedsRebuild)
+        return;
+
+    if(ColorText *run = findRun(index))
+        run->setCharacterOffset(index, offset);
+}
+
+void RichTextLine::resetCharacterEffects(){
+    m_GlyphEffects.clear();
+    m_BakeOutdated = true;
+
+    for(auto &text: m_Texts)
+        text.resetCharacterEffects();
+}
+
+void RichTextLine::setBaked(LabelAtlas* atlas){
+    if(atlas == m_Atlas)
+        return;
+
+    m_Atlas = atlas;
+    m_BakedRegion = {};
+    m_BakeOutdated = true;
+}
+
+bool RichTextLine::ensureBaked()const{
+    const bool valid = m_Atlas->isValid(m_BakedRegion);
+
+    if (!m_BakeOutdated && valid) {
+        m_Atlas->touch(m_BakedRegion);
+        return true;
+    }
+
+    RICH_TEXT_TRACE_ZONE("RichTextLine::bake");
+
+    // Whole pixels plus a margin for antialiasing, so the bake samples the glyph pages 1:1
+    sf::Vector2f origin(std::floor(m_Bounds.left) - 1.f, std::floor(m_Bounds.top) - 1.f);
+    sf::Vector2i size(
+        static_cast<int>(std::ceil(m_Bounds.left + m_Bounds.width) + 1.f - origin.x),
+        static_cast<int>(std::ceil(m_Bounds.top + m_Bounds.height) + 1.f - origin.y)
+    );
+
+    // The previous region is reused while the line still fits in the size it was allocated with
+    bool reuse = valid && m_BakedRegion.Rect.width >= size.x && m_BakedRegion.Rect.height >= size.y;
+
+    // No shelf can take it: drawn unbaked, and tried again on the next draw
+    if(!reuse && !m_Atlas->allocate(size, m_BakedRegion))
+        return false;
+
+    m_BakedSize = size;
+    m_BakedOrigin = origin;
+    m_BakeOutdated = false;
+
+    const sf::IntRect &rect = m_BakedRegion.Rect;
+    sf::RenderTarget &target = m_Atlas->beginRegion(rect);
+
+    sf::RenderStates states(LabelAtlas::PremultipliedBlend);
+    states.transform.translate(rect.left - origin.x, rect.top - origin.y);
+
+    for(const auto &text: m_Texts)
+        target.draw(text, states);
+
+    m_Atlas->display();
+
+    return true;
+}
+
+ColorText *RichTextLine::findRun(std::size_t &index)const{
+    for (auto &text : m_Texts) {
+        if(index < text.getString().getSize())
+            return &text;
+
+        index -= text.getString().getSize();
+    }
+
+    return nullptr;
+}
+
+void RichTextLine::applyGlyphEffects()const{
+    std::size_t start = 0;
+
+    for (auto &text : m_Texts) {
+        const std::size_t length = text.getString().getSize();
+
+        text.setVisibleCharacterCount(m_VisibleCount > start ? m_VisibleCount - start : 0);
+
+        for (std::size_t i = start; i < std::min(start + length, m_GlyphEffects.size()); i++) {
+            if(m_GlyphEffects[i].HasColor)
+                text.setCharacterColor(i - start, m_GlyphEffects[i].Color);
+
+            text.setCharacterOffset(i - start, m_GlyphEffects[i].Offset);
+        }
+
+        start += length;
+    }
+}
+
+const std::vector<float> &RichTextLine::characterOffsets() const{
+    ensureRebuilt();
+
+    if(m_CharacterOffsets.size())
+        return m_CharacterOffsets;
+
+    // Runs already cache their caret positions, which include their own offset in the line
+    for (const auto &text : m_Texts) {
+        for(std::size_t i = 0; i < text.getString().getSize(); i++)
+            m_CharacterOffsets.push_back(text.findCharacterPos(i).x);
+    }
+
+    m_CharacterOffsets.push_back(m_Texts.size() ? m_Texts.back().findCharacterPos(m_Texts.back().getString().getSize()).x : 0.f);
+
+    return m_CharacterOffsets;
+}
+
+std::vector<ColorText> RichTextLine::build(const RichFont &rich_font, const sf::String& string, int character_size, sf::Uint32 style){
+    RICH_TEXT_TRACE_ZONE_ARG("RichTextLine::build", "length", string.getSize());
+
     if (!rich_font.valid()) {
         LogRichText(Error, "Using invalid font for text line");
         return {};
@@ -132,6 +686,8 @@ std::vector<ColorText> RichTextLine::build(const RichFont &rich_font, const sf::
         if (!last_string.isEmpty()) {
             ColorText text(last_string, *last_font, character_size);
             text.setPosition(position);
+            // Bold and italic change the run width, so it has to be set before placing the next one
+            text.setStyle(style);
 
             //text.setOutlineThickness(outline);
             position.x += text.getLocalBounds().width; //+ outline * 2; // Consider outline thickness
@@ -162,37 +718,172 @@ std::vector<ColorText> RichTextLine::build(const RichFont &rich_font, const sf::
     return texts;
 }
 
-void RichTextLine::rebuild(const sf::String& string){
+void RichTextLine::rebuild(const sf::String& string)const{
+    RICH_TEXT_TRACE_ZONE_ARG("RichTextLine::rebuild", "length", string.getSize());
+
+    m_CharacterOffsets.clear();
+
     if(!drawn()){
         m_Texts = {};
+        m_BuiltString = {};
+        m_Bounds = {};
         return;
     }
 
-    m_Texts = RichTextLine::build(*m_Font, string, m_CharacterSize);
+    if (string == m_BuiltString && m_Texts.size()) {
+        applyGlyphEffects();
+        return;
+    }
+
+    const std::size_t old_size = m_BuiltString.getSize();
+    const std::size_t new_size = string.getSize();
+
+    std::size_t prefix = 0;
+    while (prefix < old_size && prefix < new_size && m_BuiltString[prefix] == string[prefix])
+        prefix++;
+
+    std::size_t suffix = 0;
+    while (suffix < old_size - prefix && suffix < new_size - prefix && m_BuiltString[old_size - suffix - 1] == string[new_size - suffix - 1])
+        suffix++;
+
+    // A run is kept when the characters on both sides of its boundary with the changed part are unchanged,
+    // font segmentation gives the same boundary there. 'head' runs are kept from the front, runs from 'tail' on
+    std::size_t head = 0;
+    std::size_t head_end = 0;
+    while (head < m_Texts.size() && head_end + m_Texts[head].getString().getSize() < prefix)
+        head_end += m_Texts[head++].getString().getSize();
+
+    std::size_t tail = m_Texts.size();
+    std::size_t tail_start = old_size;
+    while (tail > head && tail_start - m_Texts[tail - 1].getString().getSize() > old_size - suffix)
+        tail_start -= m_Texts[--tail].getString().getSize();
+
+    const std::size_t changed_end = new_size - (old_size - tail_start);
+
+    std::vector<ColorText> changed = RichTextLine::build(*m_Font, string.substring(head_end, changed_end - head_end), m_CharacterSize, m_Style);
+
+    float x = 0.f;
+    if (head) {
+        const ColorText &last = m_Texts[head - 1];
+        x = last.getPosition().x + last.getLocalBounds().width;
+    }
+
+    for (auto &text : changed) {
+        text.move(x, 0.f);
+        text.setFillColor(m_FillColor);
+        text.setOutlineColor(m_OutlineColor);
+        text.setOutlineThickness(m_OutlineThickness);
+    }
+
+    // Following runs keep their vertices and are only shifted by the width difference
+    if (tail < m_Texts.size()) {
+        float new_end = changed.size() ? changed.back().getPosition().x + changed.back().getLocalBounds().width : x;
+        float delta = new_end - m_Texts[tail].getPosition().x;
+
+        for(std::size_t i = tail; i < m_Texts.size(); i++)
+            m_Texts[i].move(delta, 0.f);
+    }
+
+    m_Texts.erase(m_Texts.begin() + head, m_Texts.begin() + tail);
+    m_Texts.insert(m_Texts.begin() + head, std::make_move_iterator(changed.begin()), std::make_move_iterator(changed.end()));
+
+    m_BuiltString = string;
+
+    applyGlyphEffects();
+    updateBounds();
+}
+
+void RichTextLine::updateBounds()const{
+    m_Bounds = {};
+
+    for (const auto& text : m_Texts) {
+        sf::FloatRect bounds = text.getLocalBounds();
+        bounds.left += text.getPosition().x;
+        bounds.top += text.getPosition().y;
+
+        Unite(m_Bounds, bounds);
+    }
 }
 
-void RichTextLine::rebuild(){
+void RichTextLine::invalidate(RichTextCounter reason, bool keep_runs){
+    m_NeedsRebuild = true;
+    m_RebuildReason = reason;
+    m_BakeOutdated = true;
+    m_CharacterOffsets.clear();
+
+    // Font, size or style changed, every run is laid out again
+    if (!keep_runs) {
+        m_Texts = {};
+        m_BuiltString = {};
+    }
+}
+
+void RichTextLine::ensureRebuilt()const{
+    if(!m_NeedsRebuild)
+        return;
+
+    // Cleared first, the rebuild itself may query the bounds
+    m_NeedsRebuild = false;
+
+    RICH_TEXT_COUNT_VALUE(RichTextCounters::global(), m_RebuildReason, 1);
+
+    rebuild();
+}
+
+void RichTextLine::rebuild()const{
     rebuild(m_String);
 }
 
 void RichTextLine::draw(sf::RenderTarget& target, sf::RenderStates states) const{
+    RICH_TEXT_TRACE_ZONE("RichTextLine::draw");
+
+    ensureRebuilt();
+
     if(!m_Texts.size())
         return;
 
     states.transform *= getTransform();
 
+    if (m_Atlas && ensureBaked()) {
+        float left = m_BakedOrigin.x, top = m_BakedOrigin.y;
+        float right = left + m_BakedSize.x, bottom = top + m_BakedSize.y;
+
+        float u1 = static_cast<float>(m_BakedRegion.Rect.left), v1 = static_cast<float>(m_BakedRegion.Rect.top);
+        float u2 = u1 + m_BakedSize.x, v2 = v1 + m_BakedSize.y;
+
+        const sf::Vertex quad[] = {
+            sf::Vertex({left,  top},    sf::Vector2f(u1, v1)),
+            sf::Vertex({right, top},    sf::Vector2f(u2, v1)),
+            sf::Vertex({left,  bottom}, sf::Vector2f(u1, v2)),
+            sf::Vertex({left,  bottom}, sf::Vector2f(u1, v2)),
+            sf::Vertex({right, top},    sf::Vector2f(u2, v1)),
+            sf::Vertex({right, bottom}, sf::Vector2f(u2, v2)),
+        };
+
+        states.texture = &m_Atlas->getTexture();
+        states.blendMode = sf::BlendMode(sf::BlendMode::One, sf::BlendMode::OneMinusSrcAlpha);
+
+        target.draw(quad, 6, sf::PrimitiveType::Triangles, states);
+        RICH_TEXT_COUNT(RichTextCounters::global(), DrawCalls, 1);
+        return;
+    }
+
     for (const auto &text : m_Texts) {
         target.draw(text, states);
     }
 }
 
 void ElipsisRichTextLine::setMaxWidth(int width){
+    if(width == m_MaxWidth)
+        return;
+
     m_MaxWidth = width;
 
-    rebuild();
+    // Only the truncated string changes, the runs before the cut can be kept
+    invalidate(RichTextCounter::RebuildEllipsis, true);
 }
 
-void ElipsisRichTextLine::rebuild(){
+void ElipsisRichTextLine::rebuild()const{
     RichTextLine::rebuild();
 
     if(!m_MaxWidth || !drawn())
@@ -208,5 +899,6 @@ void ElipsisRichTextLine::rebuild(){
         }
         initial.erase(initial.getSize() - 1);
         RichTextLine::rebuild(initial + L"...");
+        RICH_TEXT_COUNT(RichTextCounters::global(), EllipsisIterations, 1);
     }
 }
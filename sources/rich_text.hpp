@@ -1,29 +1,165 @@
 #pragma once
 
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include "color_text.hpp"
+#include "font_coverage.hpp"
+#include "label_atlas.hpp"
 #include <SFML/Graphics/Text.hpp>
 
+struct RichTextMetrics {
+	// Horizontal space taken by the text, where a following run would be placed
+	float Advance = 0.f;
+	// Ink bounds, the same rectangle RichTextLine::getLocalBounds reports
+	sf::FloatRect Bounds;
+};
+
+struct RichTextGlyph {
+	const ColorFont *Font = nullptr;
+	std::uint32_t Character = 0;
+	// Pen position on the baseline, where ColorText places the glyph
+	sf::Vector2f Position;
+};
+
 class RichFont {
-	std::vector<ColorFont> m_Fonts;
+	enum class FontState {
+		Unloaded,
+		Loaded,
+		Failed
+	};
+
+	// A font of the fallback chain. Entries registered by path open their file on first use,
+	// they are shared by the copies of a RichFont and its preloads
+	struct FontEntry {
+		ColorFont Font;
+		// Empty for fonts given already loaded
+		std::string Path;
+		// Where the coverage of the file is cached, empty for none
+		std::string ManifestPath;
+		// Read from a valid manifest when registered, never changed after
+		std::optional<FontCoverage> Coverage;
+		std::mutex Lock;
+		std::atomic<FontState> State{FontState::Unloaded};
+		// Manifest being written, under Lock. Declared last: it is waited for before the font goes away
+		std::future<void> ManifestWrite;
+
+		// Opens the file if that wasn't tried yet, true when the font can be used. Safe from any thread.
+		// Starts writing the manifest in the background when there was no valid one
+		bool load();
+
+		// Stamps the file and saves the coverage of the opened font, reads all of the file
+		void writeManifest();
+
+		// Returns once the manifest write started by load(), if any, is done
+		void waitForManifest();
+
+		bool isLoaded()const;
+	};
+
+	std::vector<std::shared_ptr<FontEntry>> m_Fonts;
+	// Preloads started by this RichFont, waited for on destruction
+	mutable std::vector<std::shared_future<bool>> m_Preloads;
 public:
 	RichFont(std::vector<ColorFont> &&fonts);
 
+	RichFont(const RichFont &other) = default;
+
+	RichFont(RichFont &&other) = default;
+
+	RichFont &operator=(const RichFont &other) = default;
+
+	RichFont &operator=(RichFont &&other) = default;
+
+	// Waits for the preloads it started, see flush()
+	~RichFont();
+
 	bool valid()const;
 
+	// Registers a font at the end of the chain without opening it. The file is opened the first time
+	// a codepoint isn't found in the fonts before it, or by preload(). With a valid coverage manifest
+	// the file is only opened for the codepoints it covers, see FontCoverage
+	void addFallback(const std::string &filepath, const std::string &manifest_path = {});
+
+	// Opens the fallbacks not opened yet on a background thread. The future tells if they all loaded.
+	// Call it from the thread owning the RichFont
+	std::shared_future<bool> preload()const;
+
+	// Returns once the preloads and the manifest writes started so far are done
+	void flush()const;
+
+	std::size_t getFontCount()const;
+
+	// Fonts opened so far, the ones a lazy fallback couldn't open are not counted
+	std::size_t getLoadedFontCount()const;
+
+	// Coverage read from the manifest of a fallback, null when it had none or it was stale
+	const FontCoverage *getCoverage(std::size_t index)const;
+
 	const ColorFont *findFontForGlyph(std::uint32_t codepoint)const;
 
+	// Lays the string out like RichTextLine does, using only glyph metrics: no ColorText or vertices are created.
+	// When 'offsets' is not null it must hold string.getSize() + 1 floats and receives the caret x position before each character.
+	// When 'glyphs' is not null it receives every visible glyph with its position.
+	// Bold takes the bold advances and kerning, italic shears the bounds, as the line would be drawn with 'style'
+	RichTextMetrics measure(const sf::String &string, int character_size, float *offsets = nullptr, std::vector<RichTextGlyph> *glyphs = nullptr, sf::Uint32 style = sf::Text::Regular)const;
+
+	// Sum of the memory reports of all the opened fonts
+	ColorFont::MemoryUsage getMemoryUsage()const;
+
+	// Sum of the fonts' counters and atlas occupancy, see ColorFont::getStats
+	RichTextStats getStats()const;
+
+	void resetStats();
+
+	void advanceFrame();
+
+	// Trims every font, see ColorFont::trim. The budget applies to each font, returns the bytes released
+	std::size_t trim(unsigned int max_idle_frames, std::size_t texture_budget = -1);
+
 	static RichFont loadFromFile(const std::string &filepath);
 
-	static RichFont loadFromFiles(std::initializer_list<std::string> filepath);
+	// The first font that loads is the primary one, with 'lazy_fallbacks' the ones after it are only registered, see addFallback.
+	// Their manifests are kept in 'manifest_directory' as '<font file name>.coverage' when it isn't empty
+	static RichFont loadFromFiles(std::initializer_list<std::string> filepath, bool lazy_fallbacks = true, const std::string &manifest_directory = {});
 };
 
 class RichTextLine: public sf::Drawable, public sf::Transformable{
 private:
-	std::vector<ColorText> m_Texts;
+	struct GlyphEffect {
+		bool HasColor = false;
+		sf::Color Color;
+		sf::Vector2f Offset;
+	};
+
+	mutable std::vector<ColorText> m_Texts;
+	// String the runs were built from, lets a rebuild keep the runs the new string didn't touch
+	mutable sf::String m_BuiltString;
 	sf::String m_String;
 	const RichFont *m_Font = nullptr;
 	int m_CharacterSize = 0;
+	sf::Color m_FillColor = sf::Color::White;
+	sf::Color m_OutlineColor = sf::Color::Black;
+	float m_OutlineThickness = 0.f;
+	sf::Uint32 m_Style = sf::Text::Regular;
+	mutable sf::FloatRect m_Bounds;
+	mutable std::vector<float> m_CharacterOffsets;
+	// Setters only mark the line, it is built once on first use
+	mutable bool m_NeedsRebuild = false;
+	// Last cause of invalidation, reported by the rebuild counters
+	RichTextCounter m_RebuildReason = RichTextCounter::RebuildString;
+	// Indexed by character of the whole line, forwarded to the runs holding them
+	std::vector<GlyphEffect> m_GlyphEffects;
+	std::size_t m_VisibleCount = -1;
+	// Baked mode, the line is drawn as one quad of m_Atlas
+	LabelAtlas *m_Atlas = nullptr;
+	// The region allocated, at least as large as the size last baked into it
+	mutable LabelAtlasRegion m_BakedRegion;
+	mutable sf::Vector2i m_BakedSize;
+	mutable sf::Vector2f m_BakedOrigin;
+	mutable bool m_BakeOutdated = true;
 public:
     sf::FloatRect getLocalBounds()const;
 
@@ -33,6 +169,12 @@ public:
 
 	sf::String getString()const;
 
+	const RichFont *getRichFont()const;
+
+	int getCharacterSize()const;
+
+	const sf::Color &getFillColor()const;
+
 	void setCharacterSize(int size);
 
 	void setRichFont(const RichFont &font);
@@ -46,12 +188,47 @@ public:
 	void setStyle(sf::Text::Style style);
 
 	bool drawn()const;
+
+	sf::Vector2f findCharacterPos(std::size_t index)const;
+
+	// Index of the caret position closest to the point, both in global coordinates
+	std::size_t findCharacterIndex(sf::Vector2f point)const;
+
+	// Per glyph effects, see ColorText. They are kept across rebuilds until the string changes
+	void setVisibleCharacterCount(std::size_t count);
+
+	void setCharacterColor(std::size_t index, const sf::Color &color);
+
+	void setCharacterOffset(std::size_t index, sf::Vector2f offset);
+
+	void resetCharacterEffects();
+
+	// Renders the line once into a region of 'atlas' and then draws it as a single quad, until the line
+	// or the atlas changes. Meant for labels that rarely change, null draws the runs again every frame
+	void setBaked(LabelAtlas *atlas);
 protected:
-	static std::vector<ColorText> build(const RichFont &font, const sf::String &string, int character_size);
+	static std::vector<ColorText> build(const RichFont &font, const sf::String &string, int character_size, sf::Uint32 style = sf::Text::Regular);
+
+	void rebuild(const sf::String &string)const;
+
+	void updateBounds()const;
+
+	const std::vector<float> &characterOffsets()const;
+
+	// With 'keep_runs' only the string changed, so the next rebuild may reuse untouched runs
+	void invalidate(RichTextCounter reason, bool keep_runs = false);
+
+	// Run holding the character at 'index', which is made relative to that run. Null past the end
+	ColorText *findRun(std::size_t &index)const;
+
+	void applyGlyphEffects()const;
+
+	// Makes sure the baked region is up to date, false when the line doesn't fit the atlas
+	bool ensureBaked()const;
 
-	void rebuild(const sf::String &string);
+	void ensureRebuilt()const;
 
-	virtual void rebuild();
+	virtual void rebuild()const;
 
     void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
 };
@@ -61,6 +238,6 @@ class ElipsisRichTextLine : public RichTextLine {
 public:
 	void setMaxWidth(int width);
 
-	void rebuild()override;
+	void rebuild()const override;
 };
 
@@ -0,0 +1,72 @@
+#include "rich_text_stats.hpp"
+
+std::uint64_t RichTextStats::operator[](RichTextCounter counter)const{
+	return Counters[static_cast<std::size_t>(counter)];
+}
+
+RichTextStats &RichTextStats::operator+=(const RichTextStats& other){
+	for (std::size_t i = 0; i < static_cast<std::size_t>(RichTextCounter::Count); i++)
+		Counters[i] += other.Counters[i];
+
+	AtlasUsedPixels += other.AtlasUsedPixels;
+	AtlasPixels += other.AtlasPixels;
+
+	return *this;
+}
+
+RichTextCounters::RichTextCounters(RichTextCounters *parent):
+	m_Parent(parent)
+{
+	reset();
+}
+
+RichTextCounters::RichTextCounters(const RichTextCounters& other){
+	*this = other;
+}
+
+RichTextCounters &RichTextCounters::operator=(const RichTextCounters& other){
+	for (std::size_t i = 0; i < static_cast<std::size_t>(RichTextCounter::Count); i++)
+		m_Values[i].store(other.m_Values[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+	m_Parent = other.m_Parent;
+
+	return *this;
+}
+
+void RichTextCounters::add(RichTextCounter counter, std::uint64_t value){
+	m_Values[static_cast<std::size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+
+	if(m_Parent)
+		m_Parent->add(counter, value);
+}
+
+RichTextStats RichTextCounters::snapshot()const{
+	RichTextStats stats;
+
+	for (std::size_t i = 0; i < static_cast<std::size_t>(RichTextCounter::Count); i++)
+		stats.Counters[i] = m_Values[i].load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+void RichTextCounters::reset(){
+	for (auto &value : m_Values)
+		value.store(0, std::memory_order_relaxed);
+}
+
+RichTextCounters &RichTextCounters::global(){
+	static RichTextCounters counters;
+	return counters;
+}
+
+RichTextScopedTimer::RichTextScopedTimer(RichTextCounters& counters, RichTextCounter counter):
+	m_Counters(counters),
+	m_Counter(counter),
+	m_Start(std::chrono::steady_clock::now())
+{}
+
+RichTextScopedTimer::~RichTextScopedTimer(){
+	auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Start);
+
+	m_Counters.add(m_Counter, static_cast<std::uint64_t>(elapsed.count()));
+}
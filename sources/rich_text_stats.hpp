@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Performance counters of the text rendering. They are only compiled in when RICH_TEXT_STATS is
+// defined, otherwise the macros below expand to nothing and every snapshot reads zero.
+enum class RichTextCounter {
+	GlyphCacheHits,
+	GlyphCacheMisses,
+	// Nanoseconds spent in ColorFont::loadGlyph, rasterization and upload included
+	GlyphLoadTime,
+	// Glyph loads, renders, strokes, kerning lookups and size changes
+	FreeTypeCalls,
+	AtlasRows,
+	AtlasGrowths,
+	TextureUploadBytes,
+	// Glyphs copied from and published to a SharedGlyphCache
+	SharedCacheHits,
+	SharedCachePublishes,
+	// RichTextLine rebuilds, by what caused them
+	RebuildString,
+	RebuildSize,
+	RebuildFont,
+	RebuildStyle,
+	RebuildEllipsis,
+	// Shortened strings an ElipsisRichTextLine laid out to fit its width, whatever caused the rebuild
+	EllipsisIterations,
+	DrawCalls,
+	Count
+};
+
+struct RichTextStats {
+	std::uint64_t Counters[static_cast<std::size_t>(RichTextCounter::Count)] = {};
+	// Atlas occupancy, only filled by the fonts' snapshots: pixels taken by glyph rows out of the pages' texture area
+	std::uint64_t AtlasUsedPixels = 0;
+	std::uint64_t AtlasPixels = 0;
+
+	std::uint64_t operator[](RichTextCounter counter)const;
+
+	RichTextStats &operator+=(const RichTextStats &other);
+};
+
+// Relaxed atomic counters, each ColorFont owns a set and the global set sums everything
+class RichTextCounters {
+	std::atomic<std::uint64_t> m_Values[static_cast<std::size_t>(RichTextCounter::Count)];
+	// Also receives every value added here
+	RichTextCounters *m_Parent = nullptr;
+public:
+	RichTextCounters(RichTextCounters *parent = nullptr);
+
+	// Values and parent are copied, fonts stay copyable
+	RichTextCounters(const RichTextCounters &other);
+
+	RichTextCounters &operator=(const RichTextCounters &other);
+
+	void add(RichTextCounter counter, std::uint64_t value = 1);
+
+	RichTextStats snapshot()const;
+
+	// Meant to be called once per frame, after the snapshot was sent to telemetry
+	void reset();
+
+	static RichTextCounters &global();
+};
+
+// Adds the time it lives to a counter
+class RichTextScopedTimer {
+	RichTextCounters &m_Counters;
+	RichTextCounter m_Counter;
+	std::chrono::steady_clock::time_point m_Start;
+public:
+	RichTextScopedTimer(RichTextCounters &counters, RichTextCounter counter);
+
+	~RichTextScopedTimer();
+};
+
+#ifdef RICH_TEXT_STATS
+	#define RICH_TEXT_COUNT(counters, counter, value) (counters).add(RichTextCounter::counter, value)
+	// Same with the counter given as a RichTextCounter value, for counters picked at runtime
+	#define RICH_TEXT_COUNT_VALUE(counters, counter, value) (counters).add(counter, value)
+	#define RICH_TEXT_TIME(counters, counter) RichTextScopedTimer rich_text_timer_##counter(counters, RichTextCounter::counter)
+#else
+	#define RICH_TEXT_COUNT(counters, counter, value) ((void)0)
+	#define RICH_TEXT_COUNT_VALUE(counters, counter, value) ((void)0)
+	#define RICH_TEXT_TIME(counters, counter) ((void)0)
+#endif
@@ -0,0 +1,199 @@
+#include "rich_text_trace.hpp"
+#include <bsl/log.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+DEFINE_LOG_CATEGORY(RichTextTrace)
+
+namespace {
+	std::atomic<std::uint32_t> s_NextThread{1};
+
+	// Ring of one thread. Only the export and capacity changes take its lock besides the owner, so it is uncontended
+	struct TraceBuffer {
+		std::mutex Lock;
+		std::vector<RichTextTraceEvent> Events;
+		std::size_t Capacity = 0;
+		// Total number of events recorded, the next one goes to Next % Capacity
+		std::size_t Next = 0;
+	};
+
+	// Every thread's ring, a ring outlives its thread until the next clear()
+	struct TraceRegistry {
+		std::mutex Lock;
+		std::vector<std::shared_ptr<TraceBuffer>> Buffers;
+		std::size_t Capacity = 1 << 16;
+	};
+
+	TraceRegistry &Registry(){
+		static TraceRegistry registry;
+		return registry;
+	}
+
+	TraceBuffer &ThreadBuffer(){
+		thread_local const std::shared_ptr<TraceBuffer> buffer = []() {
+			auto buffer = std::make_shared<TraceBuffer>();
+
+			TraceRegistry &registry = Registry();
+			std::lock_guard<std::mutex> lock(registry.Lock);
+
+			buffer->Capacity = registry.Capacity;
+			registry.Buffers.push_back(buffer);
+			return buffer;
+		}();
+
+		return *buffer;
+	}
+
+	void WriteEscaped(std::ostream &stream, const char *string){
+		stream << '"';
+		for (; *string; string++) {
+			if(*string == '"' || *string == '\\')
+				stream << '\\';
+			stream << *string;
+		}
+		stream << '"';
+	}
+}
+
+void RichTextTrace::setCapacity(std::size_t capacity){
+	TraceRegistry &registry = Registry();
+	std::lock_guard<std::mutex> lock(registry.Lock);
+
+	registry.Capacity = capacity;
+
+	for (const auto &buffer : registry.Buffers) {
+		std::lock_guard<std::mutex> buffer_lock(buffer->Lock);
+
+		buffer->Capacity = capacity;
+		buffer->Events.clear();
+		buffer->Events.shrink_to_fit();
+		buffer->Next = 0;
+	}
+}
+
+void RichTextTrace::clear(){
+	TraceRegistry &registry = Registry();
+	std::lock_guard<std::mutex> lock(registry.Lock);
+
+	// Only the registry still holds the rings of exited threads
+	registry.Buffers.erase(std::remove_if(registry.Buffers.begin(), registry.Buffers.end(), [](const std::shared_ptr<TraceBuffer> &buffer) {
+		return buffer.use_count() == 1;
+	}), registry.Buffers.end());
+
+	for (const auto &buffer : registry.Buffers) {
+		std::lock_guard<std::mutex> buffer_lock(buffer->Lock);
+
+		buffer->Events.clear();
+		buffer->Next = 0;
+	}
+}
+
+void RichTextTrace::record(const RichTextTraceEvent& event){
+	TraceBuffer &buffer = ThreadBuffer();
+	std::lock_guard<std::mutex> lock(buffer.Lock);
+
+	if(!buffer.Capacity)
+		return;
+
+	// Grows up to the capacity, then wraps around over the oldest events
+	if(buffer.Events.size() < buffer.Capacity)
+		buffer.Events.push_back(event);
+	else
+		buffer.Events[buffer.Next % buffer.Capacity] = event;
+
+	buffer.Next++;
+}
+
+std::vector<RichTextTraceEvent> RichTextTrace::getEvents(){
+	TraceRegistry &registry = Registry();
+	std::lock_guard<std::mutex> lock(registry.Lock);
+
+	std::vector<RichTextTraceEvent> events;
+
+	for (const auto &buffer : registry.Buffers) {
+		std::lock_guard<std::mutex> buffer_lock(buffer->Lock);
+
+		events.insert(events.end(), buffer->Events.begin(), buffer->Events.end());
+	}
+
+	// Each ring is in recording order once unwrapped, across threads only the start times order them
+	std::stable_sort(events.begin(), events.end(), [](const RichTextTraceEvent &left, const RichTextTraceEvent &right) {
+		return left.Start < right.Start;
+	});
+
+	return events;
+}
+
+void RichTextTrace::writeChromeTrace(std::ostream& stream){
+	const std::vector<RichTextTraceEvent> events = getEvents();
+
+	stream << "{\"traceEvents\":[";
+
+	for (std::size_t i = 0; i < events.size(); i++) {
+		const RichTextTraceEvent &event = events[i];
+
+		stream << (i ? ",\n" : "\n") << "{\"name\":";
+		WriteEscaped(stream, event.Name);
+		// Complete events, timestamps are in microseconds
+		stream << ",\"cat\":\"text\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.Thread
+			<< ",\"ts\":" << event.Start / 1000 << '.' << event.Start % 1000 / 100
+			<< ",\"dur\":" << event.Duration / 1000 << '.' << event.Duration % 1000 / 100;
+
+		if (event.ArgName) {
+			stream << ",\"args\":{";
+			WriteEscaped(stream, event.ArgName);
+			stream << ':' << event.Arg << '}';
+		}
+
+		stream << '}';
+	}
+
+	stream << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+bool RichTextTrace::saveChromeTrace(const std::string& path){
+	std::ofstream file(path, std::ios::binary);
+
+	if (!file) {
+		LogRichTextTrace(Error, "Can't open trace file '%'", path);
+		return false;
+	}
+
+	writeChromeTrace(file);
+
+	return static_cast<bool>(file);
+}
+
+std::uint64_t RichTextTrace::now(){
+	static const auto epoch = std::chrono::steady_clock::now();
+
+	return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+}
+
+std::uint32_t RichTextTrace::threadId(){
+	thread_local const std::uint32_t id = s_NextThread.fetch_add(1, std::memory_order_relaxed);
+
+	return id;
+}
+
+void RichTextTraceZone::begin(const char *name, const char *arg_name, std::int64_t arg){
+	m_Name = name;
+	m_ArgName = arg_name;
+	m_Arg = arg;
+	m_Start = RichTextTrace::now();
+}
+
+void RichTextTraceZone::end(){
+	RichTextTraceEvent event;
+	event.Name = m_Name;
+	event.ArgName = m_ArgName;
+	event.Arg = m_Arg;
+	event.Start = m_Start;
+	event.Duration = RichTextTrace::now() - m_Start;
+	event.Thread = RichTextTrace::threadId();
+
+	RichTextTrace::record(event);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Scoped trace zones of the text pipeline, recorded into in-memory ring buffers and exported as
+// Chrome trace-event JSON (chrome://tracing, Perfetto). Each thread records into its own ring, so
+// workers don't wait on each other to close their zones. Zones are only compiled in when
+// RICH_TEXT_TRACE is defined, and cost an inlined relaxed atomic load while tracing is disabled at runtime.
+struct RichTextTraceEvent {
+	// Names are string literals, only their address is stored
+	const char *Name = nullptr;
+	const char *ArgName = nullptr;
+	std::int64_t Arg = 0;
+	// Nanoseconds since the first zone of the process
+	std::uint64_t Start = 0;
+	std::uint64_t Duration = 0;
+	std::uint32_t Thread = 0;
+};
+
+class RichTextTrace {
+	static inline std::atomic<bool> s_Enabled{false};
+public:
+	static void setEnabled(bool enabled){
+		s_Enabled.store(enabled, std::memory_order_relaxed);
+	}
+
+	static bool isEnabled(){
+		return s_Enabled.load(std::memory_order_relaxed);
+	}
+
+	// Number of events kept per thread, the oldest ones are overwritten. Clears the buffers
+	static void setCapacity(std::size_t capacity);
+
+	// Also forgets the buffers of the threads that exited
+	static void clear();
+
+	// Into the ring of the calling thread
+	static void record(const RichTextTraceEvent &event);
+
+	// Recorded events of all the threads, oldest first
+	static std::vector<RichTextTraceEvent> getEvents();
+
+	static void writeChromeTrace(std::ostream &stream);
+
+	static bool saveChromeTrace(const std::string &path);
+
+	// Nanoseconds since the first call
+	static std::uint64_t now();
+
+	// Small sequential id of the calling thread
+	static std::uint32_t threadId();
+};
+
+class RichTextTraceZone {
+	const char *m_Name = nullptr;
+	const char *m_ArgName = nullptr;
+	std::int64_t m_Arg = 0;
+	std::uint64_t m_Start = 0;
+public:
+	RichTextTraceZone(const char *name, const char *arg_name = nullptr, std::int64_t arg = 0){
+		if(RichTextTrace::isEnabled())
+			begin(name, arg_name, arg);
+	}
+
+	RichTextTraceZone(const RichTextTraceZone &) = delete;
+
+	RichTextTraceZone &operator=(const RichTextTraceZone &) = delete;
+
+	~RichTextTraceZone(){
+		// Zones opened while tracing was disabled have no name
+		if(m_Name)
+			end();
+	}
+private:
+	void begin(const char *name, const char *arg_name, std::int64_t arg);
+
+	void end();
+};
+
+#ifdef RICH_TEXT_TRACE
+	#define RICH_TEXT_TRACE_CONCAT_(a, b) a##b
+	#define RICH_TEXT_TRACE_CONCAT(a, b) RICH_TEXT_TRACE_CONCAT_(a, b)
+	#define RICH_TEXT_TRACE_ZONE(name) RichTextTraceZone RICH_TEXT_TRACE_CONCAT(rich_text_trace_zone_, __LINE__)(name)
+	#define RICH_TEXT_TRACE_ZONE_ARG(name, arg_name, arg) RichTextTraceZone RICH_TEXT_TRACE_CONCAT(rich_text_trace_zone_, __LINE__)(name, arg_name, static_cast<std::int64_t>(arg))
+#else
+	#define RICH_TEXT_TRACE_ZONE(name) ((void)0)
+	#define RICH_TEXT_TRACE_ZONE_ARG(name, arg_name, arg) ((void)0)
+#endif
@@ -0,0 +1,349 @@
+#include "shared_glyph_cache.hpp"
+#include <bsl/log.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#define RICH_TEXT_SHARED_MEMORY
+#endif
+
+DEFINE_LOG_CATEGORY(SharedGlyphCache)
+
+namespace {
+	constexpr char s_Magic[8] = {'R', 'T', 'G', 'L', 'Y', 'P', 'H', 'S'};
+	constexpr std::uint32_t s_Version = 1;
+
+	// Slots tried from the home one before giving up, keeps a miss cheap on a crowded table
+	constexpr std::uint32_t s_MaxProbes = 64;
+
+	// Larger glyphs don't fit a page anyway, a rect past that is garbage
+	constexpr std::int32_t s_MaxGlyphSide = 4096;
+
+	// How long a process waits for the one creating the cache to finish
+	constexpr auto s_InitTimeout = std::chrono::seconds(1);
+
+	enum SlotState : std::uint32_t {
+		Writing = 0,
+		Ready = 1,
+		// The heap was full when the slot was claimed, it never becomes ready
+		Abandoned = 2
+	};
+
+	// splitmix64 finalizer
+	std::uint64_t Mix(std::uint64_t value){
+		value ^= value >> 30;
+		value *= 0xbf58476d1ce4e5b9ull;
+		value ^= value >> 27;
+		value *= 0x94d049bb133111ebull;
+		value ^= value >> 31;
+		return value;
+	}
+
+	std::uint64_t Tag(const SharedGlyphCache::Key &key){
+		std::uint64_t tag = Mix(key.Font);
+		tag = Mix(tag ^ key.Glyph);
+		tag = Mix(tag ^ (static_cast<std::uint64_t>(key.CharacterSize) << 32 | key.Format));
+
+		// Zero marks a free slot
+		return tag ? tag : 1;
+	}
+
+	// Another process writes the slots, nothing in them is trusted before it is checked against the
+	// heap and against the bitmap size the format gives, see ColorFont's shared key
+	bool IsSane(const SharedGlyphCache::Key &key, std::uint64_t offset, std::uint32_t size, const std::int32_t (&rect)[4], std::uint64_t data_bytes){
+		if(offset > data_bytes || size > data_bytes - offset)
+			return false;
+
+		const std::int32_t width = rect[2];
+		const std::int32_t height = rect[3];
+
+		if(width < 0 || height < 0 || width > s_MaxGlyphSide || height > s_MaxGlyphSide)
+			return false;
+
+		if(!width || !height)
+			return size == 0;
+
+		const std::uint64_t channels = key.Format & 0xff;
+		const std::uint64_t padding = (key.Format >> 8) & 0xff;
+
+		return size == (width + 2 * padding) * (height + 2 * padding) * channels;
+	}
+
+	static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Shared memory needs address free atomics");
+	static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "Shared memory needs address free atomics");
+}
+
+struct SharedGlyphCache::Header {
+	char Magic[8];
+	std::uint32_t Version;
+	std::uint32_t SlotCount;
+	std::uint64_t DataBytes;
+	std::atomic<std::uint32_t> Initialized;
+	std::atomic<std::uint32_t> GlyphCount;
+	std::atomic<std::uint64_t> DataUsed;
+};
+
+// Plain fields only, the layout is read by other processes of the same build
+struct SharedGlyphCache::Slot {
+	std::atomic<std::uint64_t> Tag;
+	std::atomic<std::uint32_t> State;
+	std::uint32_t Size;
+	std::uint64_t Offset;
+	Key GlyphKey;
+	float Advance;
+	std::int32_t LsbDelta;
+	std::int32_t RsbDelta;
+	float Bounds[4];
+	std::int32_t TextureRect[4];
+};
+
+bool SharedGlyphCache::Key::operator==(const Key& other)const{
+	return Font == other.Font && Glyph == other.Glyph && CharacterSize == other.CharacterSize && Format == other.Format;
+}
+
+SharedGlyphCache::~SharedGlyphCache(){
+	close();
+}
+
+bool SharedGlyphCache::open(const std::string& name, std::size_t data_bytes, std::uint32_t slot_count){
+	close();
+
+#ifdef RICH_TEXT_SHARED_MEMORY
+	if (!slot_count) {
+		LogSharedGlyphCache(Error, "Can't open '%' without slots", name);
+		return false;
+	}
+
+	const std::size_t data_offset = (sizeof(Header) + static_cast<std::size_t>(slot_count) * sizeof(Slot) + 15) & ~static_cast<std::size_t>(15);
+	const std::size_t size = data_offset + data_bytes;
+
+	bool created = true;
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+	if (fd < 0 && errno == EEXIST) {
+		created = false;
+		fd = shm_open(name.c_str(), O_RDWR, 0600);
+	}
+
+	if (fd < 0) {
+		LogSharedGlyphCache(Error, "Can't open shared memory '%': %", name, std::strerror(errno));
+		return false;
+	}
+
+	if (created && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+		LogSharedGlyphCache(Error, "Can't size shared memory '%': %", name, std::strerror(errno));
+		::close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	const auto deadline = std::chrono::steady_clock::now() + s_InitTimeout;
+
+	// The creator may not have sized the object yet
+	if (!created) {
+		struct stat info;
+		while (fstat(fd, &info) == 0 && info.st_size == 0 && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) != size) {
+			LogSharedGlyphCache(Error, "Shared memory '%' was created with other sizes", name);
+			::close(fd);
+			return false;
+		}
+	}
+
+	void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (memory == MAP_FAILED) {
+		LogSharedGlyphCache(Error, "Can't map shared memory '%': %", name, std::strerror(errno));
+		if(created)
+			shm_unlink(name.c_str());
+		return false;
+	}
+
+	Header *header = static_cast<Header*>(memory);
+	Slot *slots = reinterpret_cast<Slot*>(static_cast<std::uint8_t*>(memory) + sizeof(Header));
+
+	if (created) {
+		new (header) Header();
+		std::memcpy(header->Magic, s_Magic, sizeof(s_Magic));
+		header->Version = s_Version;
+		header->SlotCount = slot_count;
+		header->DataBytes = data_bytes;
+
+		for (std::uint32_t i = 0; i < slot_count; i++)
+			new (slots + i) Slot();
+
+		header->Initialized.store(1, std::memory_order_release);
+	} else {
+		while (!header->Initialized.load(std::memory_order_acquire) && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		const bool valid = header->Initialized.load(std::memory_order_acquire)
+			&& std::memcmp(header->Magic, s_Magic, sizeof(s_Magic)) == 0
+			&& header->Version == s_Version
+			&& header->SlotCount == slot_count
+			&& header->DataBytes == data_bytes;
+
+		if (!valid) {
+			LogSharedGlyphCache(Error, "Shared memory '%' is not a glyph cache of this layout", name);
+			munmap(memory, size);
+			return false;
+		}
+	}
+
+	m_Memory = memory;
+	m_Size = size;
+	m_Header = header;
+	m_Slots = slots;
+	m_Data = static_cast<std::uint8_t*>(memory) + data_offset;
+
+	return true;
+#else
+	LogSharedGlyphCache(Error, "Shared memory is not supported on this platform, '%' stays local", name);
+	return false;
+#endif
+}
+
+void SharedGlyphCache::close(){
+#ifdef RICH_TEXT_SHARED_MEMORY
+	if(m_Memory)
+		munmap(m_Memory, m_Size);
+#endif
+
+	m_Memory = nullptr;
+	m_Size = 0;
+	m_Header = nullptr;
+	m_Slots = nullptr;
+	m_Data = nullptr;
+}
+
+bool SharedGlyphCache::isOpen()const{
+	return m_Memory;
+}
+
+bool SharedGlyphCache::find(const Key& key, sf::Glyph& glyph, std::vector<sf::Uint8>& pixels)const{
+	if(!m_Memory)
+		return false;
+
+	const std::uint64_t tag = Tag(key);
+
+	for (std::uint32_t probe = 0; probe < s_MaxProbes; probe++) {
+		const Slot &slot = m_Slots[(tag + probe) % m_Header->SlotCount];
+		const std::uint64_t slot_tag = slot.Tag.load(std::memory_order_acquire);
+
+		// Entries are never removed, past a free slot there is nothing to find
+		if(!slot_tag)
+			return false;
+
+		// The acquire pairs with the writer's release, the fields below are complete once ready
+		if(slot_tag != tag || slot.State.load(std::memory_order_acquire) != Ready || !(slot.GlyphKey == key))
+			continue;
+
+		if (!IsSane(key, slot.Offset, slot.Size, slot.TextureRect, m_Header->DataBytes)) {
+			LogSharedGlyphCache(Error, "Skipping a corrupt entry of glyph % at size %", key.Glyph, key.CharacterSize);
+			return false;
+		}
+
+		glyph.advance = slot.Advance;
+		glyph.lsbDelta = slot.LsbDelta;
+		glyph.rsbDelta = slot.RsbDelta;
+		glyph.bounds = sf::FloatRect(slot.Bounds[0], slot.Bounds[1], slot.Bounds[2], slot.Bounds[3]);
+		glyph.textureRect = sf::IntRect(slot.TextureRect[0], slot.TextureRect[1], slot.TextureRect[2], slot.TextureRect[3]);
+		pixels.assign(m_Data + slot.Offset, m_Data + slot.Offset + slot.Size);
+
+		return true;
+	}
+
+	return false;
+}
+
+bool SharedGlyphCache::publish(const Key& key, const sf::Glyph& glyph, const sf::Uint8* pixels, std::size_t size){
+	if(!m_Memory)
+		return false;
+
+	const std::uint64_t aligned = (static_cast<std::uint64_t>(size) + 15) & ~static_cast<std::uint64_t>(15);
+
+	// A full heap would burn a slot per glyph, only writers racing for the last bytes still can
+	if(m_Header->DataUsed.load(std::memory_order_relaxed) + size > m_Header->DataBytes)
+		return false;
+
+	const std::uint64_t tag = Tag(key);
+
+	for (std::uint32_t probe = 0; probe < s_MaxProbes; probe++) {
+		Slot &slot = m_Slots[(tag + probe) % m_Header->SlotCount];
+		std::uint64_t slot_tag = 0;
+
+		if (slot.Tag.compare_exchange_strong(slot_tag, tag, std::memory_order_acq_rel, std::memory_order_acquire)) {
+			// The slot is ours, nobody reads its fields before it is marked ready
+			slot.GlyphKey = key;
+			slot.Advance = glyph.advance;
+			slot.LsbDelta = glyph.lsbDelta;
+			slot.RsbDelta = glyph.rsbDelta;
+			slot.Bounds[0] = glyph.bounds.left;
+			slot.Bounds[1] = glyph.bounds.top;
+			slot.Bounds[2] = glyph.bounds.width;
+			slot.Bounds[3] = glyph.bounds.height;
+			slot.TextureRect[0] = glyph.textureRect.left;
+			slot.TextureRect[1] = glyph.textureRect.top;
+			slot.TextureRect[2] = glyph.textureRect.width;
+			slot.TextureRect[3] = glyph.textureRect.height;
+
+			const std::uint64_t offset = m_Header->DataUsed.fetch_add(aligned, std::memory_order_relaxed);
+
+			if (offset + size > m_Header->DataBytes) {
+				slot.State.store(Abandoned, std::memory_order_release);
+				return false;
+			}
+
+			if(size)
+				std::memcpy(m_Data + offset, pixels, size);
+			slot.Offset = offset;
+			slot.Size = static_cast<std::uint32_t>(size);
+
+			slot.State.store(Ready, std::memory_order_release);
+			m_Header->GlyphCount.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		// Same tag being written is almost surely the same glyph, rasterized by another process right now
+		if (slot_tag == tag) {
+			const std::uint32_t state = slot.State.load(std::memory_order_acquire);
+
+			if(state == Writing || (state == Ready && slot.GlyphKey == key))
+				return false;
+		}
+	}
+
+	return false;
+}
+
+std::size_t SharedGlyphCache::getGlyphCount()const{
+	return m_Header ? m_Header->GlyphCount.load(std::memory_order_relaxed) : 0;
+}
+
+std::size_t SharedGlyphCache::getDataUsed()const{
+	if(!m_Header)
+		return 0;
+
+	return static_cast<std::size_t>(std::min(m_Header->DataUsed.load(std::memory_order_relaxed), m_Header->DataBytes));
+}
+
+bool SharedGlyphCache::remove(const std::string& name){
+#ifdef RICH_TEXT_SHARED_MEMORY
+	return shm_unlink(name.c_str()) == 0;
+#else
+	return false;
+#endif
+}
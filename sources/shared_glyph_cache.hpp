@@ -0,0 +1,69 @@
+#pragma once
+
+#include <SFML/Graphics/Glyph.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Glyph bitmaps shared between the processes of a host through a named shared memory object, so a
+// glyph rasterized by one renderer is copied into the atlas of the others instead of going through
+// FreeType again. Entries are published lock-free: a writer claims a slot of an open addressed table
+// with a compare-exchange, copies the bitmap into a bump-allocated heap and marks the slot ready with
+// a release store. Nothing is ever evicted, once the heap or the table is full new glyphs just stay
+// local. A process dying mid-write leaves its slot unusable, never half-read. POSIX only, open()
+// fails elsewhere and fonts keep rasterizing on their own.
+class SharedGlyphCache {
+public:
+	struct Key {
+		// Content hash of the font file, see FontFileStamp
+		std::uint64_t Font = 0;
+		// Glyph index combined with the style, as ColorFont keys its pages
+		std::uint64_t Glyph = 0;
+		std::uint32_t CharacterSize = 0;
+		// Channels of the bitmap in the low byte, its padding in pixels in the next one
+		std::uint32_t Format = 0;
+
+		bool operator==(const Key &other)const;
+	};
+private:
+	struct Header;
+	struct Slot;
+
+	void *m_Memory = nullptr;
+	std::size_t m_Size = 0;
+	Header *m_Header = nullptr;
+	Slot *m_Slots = nullptr;
+	std::uint8_t *m_Data = nullptr;
+public:
+	SharedGlyphCache() = default;
+
+	SharedGlyphCache(const SharedGlyphCache &) = delete;
+
+	SharedGlyphCache &operator=(const SharedGlyphCache &) = delete;
+
+	~SharedGlyphCache();
+
+	// Maps the cache, creating it when this is the first process. Every process must use the same
+	// sizes for a name, a mismatch fails. The name follows shm_open rules: a leading '/', no other
+	bool open(const std::string &name, std::size_t data_bytes = 64 << 20, std::uint32_t slot_count = 1 << 16);
+
+	// Unmaps the cache, it lives on for the other processes
+	void close();
+
+	bool isOpen()const;
+
+	// Copies a published glyph out, false when it isn't there (yet)
+	bool find(const Key &key, sf::Glyph &glyph, std::vector<sf::Uint8> &pixels)const;
+
+	// False when the glyph is already there or being written, or the cache is full
+	bool publish(const Key &key, const sf::Glyph &glyph, const sf::Uint8 *pixels, std::size_t size);
+
+	// Glyphs published by all the processes
+	std::size_t getGlyphCount()const;
+
+	// Bytes of bitmap data used out of the heap
+	std::size_t getDataUsed()const;
+
+	// Removes the name, processes that mapped the cache keep it until they close it
+	static bool remove(const std::string &name);
+};
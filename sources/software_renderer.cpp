@@ -0,0 +1,256 @@
+#include "software_renderer.hpp"
+#include <bsl/log.hpp>
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define RICH_TEXT_SSE2
+#endif
+
+DEFINE_LOG_CATEGORY(SoftwareRenderer)
+
+namespace {
+	// Exact rounded x / 255 for x <= 255 * 255
+	inline unsigned int Div255(unsigned int x){
+		x += 128;
+		return (x + (x >> 8)) >> 8;
+	}
+
+	// Source over, as sf::BlendAlpha does it: color weighted by the source alpha, alpha accumulated
+	inline void BlendPixel(sf::Uint8 *dst, const sf::Uint8 *texel, const sf::Color &color){
+		const unsigned int r = Div255(texel[0] * color.r);
+		const unsigned int g = Div255(texel[1] * color.g);
+		const unsigned int b = Div255(texel[2] * color.b);
+		const unsigned int a = Div255(texel[3] * color.a);
+		const unsigned int inv = 255 - a;
+
+		dst[0] = static_cast<sf::Uint8>(Div255(r * a) + Div255(dst[0] * inv));
+		dst[1] = static_cast<sf::Uint8>(Div255(g * a) + Div255(dst[1] * inv));
+		dst[2] = static_cast<sf::Uint8>(Div255(b * a) + Div255(dst[2] * inv));
+		dst[3] = static_cast<sf::Uint8>(a + Div255(dst[3] * inv));
+	}
+
+#ifdef RICH_TEXT_SSE2
+	inline __m128i Div255(__m128i x){
+		x = _mm_add_epi16(x, _mm_set1_epi16(128));
+		return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+	}
+
+	// Two pixels widened to 16 bit lanes, same arithmetic as BlendPixel
+	inline __m128i BlendPixels(__m128i dst, __m128i texel, __m128i color){
+		const __m128i rgb_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+		const __m128i alpha_one = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+		const __m128i src = Div255(_mm_mullo_epi16(texel, color));
+		const __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		const __m128i weight = _mm_or_si128(_mm_and_si128(alpha, rgb_mask), alpha_one);
+		const __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+
+		return _mm_add_epi16(Div255(_mm_mullo_epi16(src, weight)), Div255(_mm_mullo_epi16(dst, inv)));
+	}
+#endif
+
+	void BlendRow(sf::Uint8 *dst, const sf::Uint8 *texels, std::size_t count, const sf::Color &color){
+		std::size_t i = 0;
+
+#ifdef RICH_TEXT_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i color16 = _mm_set_epi16(color.a, color.b, color.g, color.r, color.a, color.b, color.g, color.r);
+
+		for (; i + 4 <= count; i += 4) {
+			const __m128i texel = _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + i * 4));
+			const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+
+			const __m128i low  = BlendPixels(_mm_unpacklo_epi8(pixels, zero), _mm_unpacklo_epi8(texel, zero), color16);
+			const __m128i high = BlendPixels(_mm_unpackhi_epi8(pixels, zero), _mm_unpackhi_epi8(texel, zero), color16);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(low, high));
+		}
+#endif
+
+		for (; i < count; i++)
+			BlendPixel(dst + i * 4, texels + i * 4, color);
+	}
+
+	// Box filter, color is averaged weighted by alpha so transparent texels don't darken the edges
+	std::vector<sf::Uint8> Resample(const std::vector<sf::Uint8> &pixels, sf::Vector2i from, sf::Vector2i to){
+		std::vector<sf::Uint8> result(static_cast<std::size_t>(to.x) * to.y * 4);
+
+		for (int y = 0; y < to.y; y++) {
+			const int y0 = y * from.y / to.y;
+			const int y1 = std::max(y0 + 1, (y + 1) * from.y / to.y);
+
+			for (int x = 0; x < to.x; x++) {
+				const int x0 = x * from.x / to.x;
+				const int x1 = std::max(x0 + 1, (x + 1) * from.x / to.x);
+
+				unsigned long sum[4] = {};
+				for (int sy = y0; sy < y1; sy++) {
+					for (int sx = x0; sx < x1; sx++) {
+						const sf::Uint8 *texel = &pixels[(static_cast<std::size_t>(sy) * from.x + sx) * 4];
+						sum[0] += texel[0] * texel[3];
+						sum[1] += texel[1] * texel[3];
+						sum[2] += texel[2] * texel[3];
+						sum[3] += texel[3];
+					}
+				}
+
+				sf::Uint8 *out = &result[(static_cast<std::size_t>(y) * to.x + x) * 4];
+				const unsigned long count = static_cast<unsigned long>(x1 - x0) * (y1 - y0);
+
+				if (sum[3]) {
+					out[0] = static_cast<sf::Uint8>(sum[0] / sum[3]);
+					out[1] = static_cast<sf::Uint8>(sum[1] / sum[3]);
+					out[2] = static_cast<sf::Uint8>(sum[2] / sum[3]);
+				}
+				out[3] = static_cast<sf::Uint8>(sum[3] / count);
+			}
+		}
+
+		return result;
+	}
+}
+
+SoftwareCanvas::SoftwareCanvas(unsigned int width, unsigned int height, const sf::Color& color):
+	m_Width(width),
+	m_Height(height),
+	m_Pixels(static_cast<std::size_t>(width) * height * 4)
+{
+	clear(color);
+}
+
+void SoftwareCanvas::clear(const sf::Color& color){
+	for (std::size_t i = 0; i < m_Pixels.size(); i += 4) {
+		m_Pixels[i + 0] = color.r;
+		m_Pixels[i + 1] = color.g;
+		m_Pixels[i + 2] = color.b;
+		m_Pixels[i + 3] = color.a;
+	}
+}
+
+unsigned int SoftwareCanvas::getWidth()const{
+	return m_Width;
+}
+
+unsigned int SoftwareCanvas::getHeight()const{
+	return m_Height;
+}
+
+sf::Uint8 *SoftwareCanvas::getPixels(){
+	return m_Pixels.data();
+}
+
+const sf::Uint8 *SoftwareCanvas::getPixels()const{
+	return m_Pixels.data();
+}
+
+sf::Image SoftwareCanvas::toImage()const{
+	sf::Image image;
+	image.create(m_Width, m_Height, m_Pixels.data());
+	return image;
+}
+
+bool SoftwareRenderer::GlyphKey::operator<(const GlyphKey& other)const{
+	return std::tie(Font, Character, Size) < std::tie(other.Font, other.Character, other.Size);
+}
+
+void SoftwareRenderer::draw(SoftwareCanvas& canvas, const RichTextLine& line, sf::Vector2f position)const{
+	if(!line.getRichFont())
+		return;
+
+	draw(canvas, *line.getRichFont(), line.getString(), line.getCharacterSize(), line.getFillColor(), position + line.getPosition());
+}
+
+void SoftwareRenderer::draw(SoftwareCanvas& canvas, const RichFont& font, const sf::String& string, int character_size, const sf::Color& color, sf::Vector2f position)const{
+	if (!font.valid() || character_size <= 0) {
+		LogSoftwareRenderer(Error, "Can't draw with an invalid font or character size");
+		return;
+	}
+
+	// Fonts can be queried from any thread, only the bitmap table needs the lock
+	std::vector<RichTextGlyph> glyphs;
+	font.measure(string, character_size, nullptr, &glyphs);
+
+	std::vector<PlacedGlyph> placed;
+	placed.reserve(glyphs.size());
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		for (const auto &glyph : glyphs) {
+			auto bitmap = findGlyph(*glyph.Font, glyph.Character, character_size);
+
+			if(!bitmap)
+				continue;
+
+			sf::Vector2i pen(static_cast<int>(std::lround(position.x + glyph.Position.x)), static_cast<int>(std::lround(position.y + glyph.Position.y)));
+
+			placed.push_back({pen + bitmap->Offset, glyph.Font->isColorEmojiFont() ? sf::Color::White : color, std::move(bitmap)});
+		}
+	}
+
+	for (const auto &glyph : placed)
+		composite(canvas, glyph);
+}
+
+void SoftwareRenderer::clear(){
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	m_Glyphs.clear();
+}
+
+std::size_t SoftwareRenderer::getGlyphCount()const{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	return m_Glyphs.size();
+}
+
+std::shared_ptr<const SoftwareRenderer::GlyphBitmap> SoftwareRenderer::findGlyph(const ColorFont& font, sf::Uint32 character, unsigned int size)const{
+	const GlyphKey key{&font, character, size};
+
+	auto it = m_Glyphs.find(key);
+	if(it != m_Glyphs.end())
+		return it->second;
+
+	std::vector<sf::Uint8> pixels;
+	const sf::Glyph glyph = font.rasterizeGlyph(character, size, false, pixels);
+
+	auto bitmap = std::make_shared<GlyphBitmap>();
+	bitmap->Offset = sf::Vector2i(static_cast<int>(std::floor(glyph.bounds.left)), static_cast<int>(std::floor(glyph.bounds.top)));
+	bitmap->Size = sf::Vector2i(static_cast<int>(std::lround(glyph.bounds.width)), static_cast<int>(std::lround(glyph.bounds.height)));
+
+	const sf::Vector2i native(glyph.textureRect.width, glyph.textureRect.height);
+
+	// Color strikes come at their native size and are scaled down to the size the glyph takes on screen
+	if(native == bitmap->Size)
+		bitmap->Pixels = std::move(pixels);
+	else if(native.x > 0 && native.y > 0 && bitmap->Size.x > 0 && bitmap->Size.y > 0)
+		bitmap->Pixels = Resample(pixels, native, bitmap->Size);
+	else
+		bitmap->Size = {};
+
+	m_Glyphs.emplace(key, bitmap);
+
+	return bitmap;
+}
+
+void SoftwareRenderer::composite(SoftwareCanvas& canvas, const PlacedGlyph& glyph){
+	const GlyphBitmap &bitmap = *glyph.Bitmap;
+
+	const int left   = std::max(glyph.Position.x, 0);
+	const int top    = std::max(glyph.Position.y, 0);
+	const int right  = std::min(glyph.Position.x + bitmap.Size.x, static_cast<int>(canvas.getWidth()));
+	const int bottom = std::min(glyph.Position.y + bitmap.Size.y, static_cast<int>(canvas.getHeight()));
+
+	if(left >= right || top >= bottom)
+		return;
+
+	for (int y = top; y < bottom; y++) {
+		sf::Uint8 *dst = canvas.getPixels() + (static_cast<std::size_t>(y) * canvas.getWidth() + left) * 4;
+		const sf::Uint8 *texels = bitmap.Pixels.data() + (static_cast<std::size_t>(y - glyph.Position.y) * bitmap.Size.x + (left - glyph.Position.x)) * 4;
+
+		BlendRow(dst, texels, right - left, glyph.Color);
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "rich_text.hpp"
+#include <SFML/Graphics/Image.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// RGBA image in CPU memory, pixels are stored row by row without padding
+class SoftwareCanvas {
+	unsigned int m_Width = 0;
+	unsigned int m_Height = 0;
+	std::vector<sf::Uint8> m_Pixels;
+public:
+	SoftwareCanvas(unsigned int width, unsigned int height, const sf::Color &color = sf::Color::Transparent);
+
+	void clear(const sf::Color &color);
+
+	unsigned int getWidth()const;
+
+	unsigned int getHeight()const;
+
+	sf::Uint8 *getPixels();
+
+	const sf::Uint8 *getPixels()const;
+
+	sf::Image toImage()const;
+};
+
+// Draws rich text into a SoftwareCanvas without OpenGL, for servers and headless tools. Glyphs are
+// rasterized once with ColorFont::rasterizeGlyph and kept in CPU memory, color emoji are resampled
+// to their on-screen size. Only the bitmap lookup goes through a lock, layout and compositing do
+// not: workers can share one renderer and fill their own canvases in parallel. Bold, outline and
+// per-glyph effects are not supported.
+class SoftwareRenderer {
+	struct GlyphKey {
+		const ColorFont *Font;
+		sf::Uint32 Character;
+		unsigned int Size;
+
+		bool operator<(const GlyphKey &other)const;
+	};
+
+	struct GlyphBitmap {
+		// Offset of the top left pixel from the pen position
+		sf::Vector2i Offset;
+		sf::Vector2i Size;
+		std::vector<sf::Uint8> Pixels;
+	};
+
+	struct PlacedGlyph {
+		sf::Vector2i Position;
+		sf::Color Color;
+		std::shared_ptr<const GlyphBitmap> Bitmap;
+	};
+
+	mutable std::mutex m_Lock;
+	// Bitmaps are shared, so clear() can't pull one from under a draw in progress
+	mutable std::map<GlyphKey, std::shared_ptr<const GlyphBitmap>> m_Glyphs;
+public:
+	// Draws the line with its fill color, the position is added to the line's own one
+	void draw(SoftwareCanvas &canvas, const RichTextLine &line, sf::Vector2f position = {})const;
+
+	void draw(SoftwareCanvas &canvas, const RichFont &font, const sf::String &string, int character_size, const sf::Color &color, sf::Vector2f position)const;
+
+	void clear();
+
+	std::size_t getGlyphCount()const;
+private:
+	// Requires m_Lock
+	std::shared_ptr<const GlyphBitmap> findGlyph(const ColorFont &font, sf::Uint32 character, unsigned int size)const;
+
+	static void composite(SoftwareCanvas &canvas, const PlacedGlyph &glyph);
+};
@@ -0,0 +1,188 @@
+#include "streaming_log.hpp"
+#include "glyph_quad.hpp"
+#include <SFML/Graphics/RenderTarget.hpp>
+#include <algorithm>
+
+StreamingLog::StreamingLog(std::size_t max_lines, std::size_t max_characters):
+	m_MaxLines(max_lines),
+	m_MaxCharacters(max_characters),
+	m_Characters(max_characters),
+	m_Vertices(max_characters * 6),
+	m_Runs(max_characters),
+	m_Lines(max_lines)
+{}
+
+void StreamingLog::setRichFont(const RichFont& font){
+	m_Font = &font;
+
+	updateLineSpacing();
+}
+
+void StreamingLog::setCharacterSize(int size){
+	m_CharacterSize = size;
+
+	updateLineSpacing();
+}
+
+void StreamingLog::setFillColor(const sf::Color& color){
+	m_FillColor = color;
+}
+
+void StreamingLog::append(const sf::String& string){
+	append(string, m_FillColor);
+}
+
+void StreamingLog::append(const sf::String& string, const sf::Color& color){
+	if(!drawn() || !m_MaxLines || !m_MaxCharacters)
+		return;
+
+	// Full ring: the oldest line gives its slot to the new one
+	if(m_Count == m_MaxLines){
+		m_First = (m_First + 1) % m_MaxLines;
+		m_Count--;
+	}
+
+	// Empty lines take a cell too, so every line owns a distinct range of the rings
+	const std::size_t length = std::min(string.getSize(), m_MaxCharacters);
+	const std::size_t cells = std::max<std::size_t>(length, 1);
+
+	std::size_t begin = m_Count ? m_End : 0;
+
+	// Lines are contiguous, one that doesn't fit before the end of the rings starts over at the front
+	if(begin + cells > m_MaxCharacters){
+		evict(begin, m_MaxCharacters);
+		begin = 0;
+	}
+	evict(begin, begin + cells);
+
+	std::size_t slot = (m_First + m_Count) % m_MaxLines;
+	m_Count++;
+	m_End = begin + cells;
+
+	Line &line = m_Lines[slot];
+	line.Begin = begin;
+	line.Length = length;
+	line.Color = color;
+	std::copy(string.begin(), string.begin() + length, m_Characters.begin() + begin);
+
+	writeLine(slot);
+}
+
+void StreamingLog::evict(std::size_t begin, std::size_t end){
+	// Lines follow each other through the rings from the oldest one, the ones in the way are the oldest
+	while (m_Count && m_Lines[m_First].Begin >= begin && m_Lines[m_First].Begin < end) {
+		m_First = (m_First + 1) % m_MaxLines;
+		m_Count--;
+	}
+}
+
+void StreamingLog::writeLine(std::size_t slot)const{
+	const unsigned int size = m_CharacterSize;
+	Line &line = m_Lines[slot];
+	const std::uint32_t *characters = &m_Characters[line.Begin];
+	sf::Vertex *vertices = &m_Vertices[line.Begin * 6];
+	Run *runs = &m_Runs[line.Begin];
+
+	line.RunCount = 0;
+
+	std::size_t quads = 0;
+	float x = 0.f;
+	const float y = static_cast<float>(size);
+	const ColorFont *prev_font = nullptr;
+	std::uint32_t prev_char = 0;
+
+	for (std::size_t i = 0; i < line.Length; i++) {
+		std::uint32_t character = characters[i];
+		const ColorFont *font = m_Font->findFontForGlyph(character);
+
+		if(font == prev_font)
+			x += font->getKerning(prev_char, character, size);
+
+		prev_font = font;
+		prev_char = character;
+
+		switch (character) {
+			case L' ':  x += font->getGlyph(L' ', size, false).advance;     continue;
+			case L'\t': x += font->getGlyph(L' ', size, false).advance * 4; continue;
+			case L'\r':
+			case L'\n': continue;
+		}
+
+		const sf::Glyph &glyph = font->getGlyph(character, size, false);
+
+		if(!line.RunCount || runs[line.RunCount - 1].Font != font)
+			runs[line.RunCount++] = Run{font, quads * 6, 0, 0};
+
+		WriteGlyphQuad(vertices + quads * 6, sf::Vector2f(x, y), font->isColorEmojiFont() ? sf::Color::White : line.Color, glyph);
+		runs[line.RunCount - 1].Count += 6;
+		quads++;
+
+		x += glyph.advance;
+	}
+
+	// After the lookups, the first glyph loaded into a page creates it
+	for(std::size_t r = 0; r < line.RunCount; r++)
+		runs[r].PageId = runs[r].Font->getPageId(size);
+
+	line.Width = x;
+}
+
+void StreamingLog::clear(){
+	m_First = 0;
+	m_Count = 0;
+	m_End = 0;
+}
+
+std::size_t StreamingLog::getLineCount()const{
+	return m_Count;
+}
+
+float StreamingLog::getLineSpacing()const{
+	return m_LineSpacing;
+}
+
+bool StreamingLog::drawn()const{
+	return m_CharacterSize && m_Font && m_Font->valid();
+}
+
+void StreamingLog::updateLineSpacing(){
+	// Cached quads were laid out for the previous font or size
+	clear();
+
+	m_LineSpacing = drawn() ? m_Font->findFontForGlyph(L' ')->getLineSpacing(m_CharacterSize) : 0.f;
+}
+
+void StreamingLog::draw(sf::RenderTarget& target, sf::RenderStates states) const{
+	if(!m_Count)
+		return;
+
+	states.transform *= getTransform();
+
+	for (std::size_t i = 0; i < m_Count; i++) {
+		std::size_t slot = (m_First + i) % m_MaxLines;
+
+		const Line &line = m_Lines[slot];
+
+		// A trimmed page comes back with a new id and other texture rects
+		for (std::size_t r = 0; r < line.RunCount; r++) {
+			const Run &run = m_Runs[line.Begin + r];
+
+			if (run.Font->getPageId(m_CharacterSize) != run.PageId) {
+				writeLine(slot);
+				break;
+			}
+		}
+
+		const sf::Vertex *vertices = &m_Vertices[line.Begin * 6];
+		const Run *runs = &m_Runs[line.Begin];
+
+		sf::RenderStates line_states = states;
+		line_states.transform.translate(0.f, m_LineSpacing * i);
+
+		for (std::size_t r = 0; r < line.RunCount; r++) {
+			line_states.texture = &runs[r].Font->getTexture(m_CharacterSize);
+			target.draw(vertices + runs[r].Offset, runs[r].Count, sf::PrimitiveType::Triangles, line_states);
+			RICH_TEXT_COUNT(RichTextCounters::global(), DrawCalls, 1);
+		}
+	}
+}
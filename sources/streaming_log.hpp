@@ -0,0 +1,77 @@
+#pragma once
+
+#include "rich_text.hpp"
+
+// Append-only console view. Characters, runs and glyph quads live in rings sized by a character budget
+// shared by all lines: each line takes as many cells as it has characters and appending evicts the
+// oldest lines until the new one fits, so once the glyphs are cached appending does no heap allocation.
+// The characters are kept too, a line whose font page was released by ColorFont::trim is rewritten
+// before it is drawn.
+class StreamingLog: public sf::Drawable, public sf::Transformable{
+	struct Run {
+		const ColorFont *Font = nullptr;
+		std::size_t Offset = 0;
+		std::size_t Count = 0;
+		// Page the texture coordinates point into, see ColorFont::getPageId
+		sf::Uint64 PageId = 0;
+	};
+
+	struct Line {
+		// First cell of the line in the rings, the characters, runs and quads of a cell share its index
+		std::size_t Begin = 0;
+		std::size_t RunCount = 0;
+		float Width = 0.f;
+		std::size_t Length = 0;
+		sf::Color Color;
+	};
+
+	std::size_t m_MaxLines = 0;
+	std::size_t m_MaxCharacters = 0;
+	// One cell per character: the character, a quad of vertices and at worst a run
+	std::vector<std::uint32_t> m_Characters;
+	mutable std::vector<sf::Vertex> m_Vertices;
+	mutable std::vector<Run> m_Runs;
+	mutable std::vector<Line> m_Lines;
+	// Ring position of the oldest line and number of lines in use
+	std::size_t m_First = 0;
+	std::size_t m_Count = 0;
+	// Cell following the newest line
+	std::size_t m_End = 0;
+
+	const RichFont *m_Font = nullptr;
+	int m_CharacterSize = 0;
+	float m_LineSpacing = 0.f;
+	sf::Color m_FillColor = sf::Color::White;
+public:
+	// Keeps at most 'max_lines' lines holding 'max_characters' characters together
+	StreamingLog(std::size_t max_lines, std::size_t max_characters);
+
+	void setRichFont(const RichFont &font);
+
+	void setCharacterSize(int size);
+
+	void setFillColor(const sf::Color &color);
+
+	// Characters past the character budget are dropped
+	void append(const sf::String &string);
+
+	void append(const sf::String &string, const sf::Color &color);
+
+	void clear();
+
+	std::size_t getLineCount()const;
+
+	float getLineSpacing()const;
+private:
+	bool drawn()const;
+
+	void updateLineSpacing();
+
+	// Frees the cells [begin, end) of the rings by evicting the oldest lines up to them
+	void evict(std::size_t begin, std::size_t end);
+
+	// Lays the stored characters of a line out into its cells
+	void writeLine(std::size_t slot)const;
+
+	void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
+};
@@ -0,0 +1,249 @@
+#include "text_layout.hpp"
+#include "glyph_quad.hpp"
+#include <SFML/Graphics/RenderTarget.hpp>
+
+namespace {
+	// Enough work per job to not spend the time in the queue
+	constexpr std::size_t s_LayoutBatch = 64;
+}
+
+TextLayout TextLayout::create(const RichFont& font, const sf::String& string, int character_size, const sf::Color& color){
+	RICH_TEXT_TRACE_ZONE_ARG("TextLayout::create", "length", string.getSize());
+
+	TextLayout layout;
+	layout.m_Font = &font;
+	layout.m_String = string;
+	layout.m_CharacterSize = character_size;
+	layout.m_Color = color;
+
+	// Positions come from the same metrics pass the lines use, so a layout matches RichTextLine to the pixel
+	std::vector<RichTextGlyph> glyphs;
+	layout.m_Metrics = font.measure(string, character_size, nullptr, &glyphs);
+
+	if(glyphs.empty())
+		return layout;
+
+	const unsigned int size = character_size;
+
+	for (const auto &glyph : glyphs) {
+		if (layout.m_Runs.empty() || layout.m_Runs.back().Font != glyph.Font) {
+			layout.m_Runs.emplace_back();
+			layout.m_Runs.back().Font = glyph.Font;
+			layout.m_Runs.back().Vector = glyph.Font->isVectorSize(size);
+		}
+
+		GlyphRun &run = layout.m_Runs.back();
+		const sf::Color glyph_color = glyph.Font->isColorEmojiFont() ? sf::Color::White : color;
+
+		if (run.Vector) {
+			for (const auto &point : glyph.Font->getGlyphMesh(glyph.Character, size, false))
+				run.Vertices.emplace_back(glyph.Position + point, glyph_color);
+		} else {
+			run.Vertices.resize(run.Vertices.size() + 6);
+			WriteGlyphQuad(&run.Vertices[run.Vertices.size() - 6], glyph.Position, glyph_color, glyph.Font->getGlyph(glyph.Character, size, false));
+		}
+	}
+
+	// After the lookups, the page was created by the first glyph loaded into it
+	for (auto &run : layout.m_Runs) {
+		if(!run.Vector)
+			run.PageId = run.Font->getPageId(size);
+	}
+
+	return layout;
+}
+
+const RichFont *TextLayout::getRichFont()const{
+	return m_Font;
+}
+
+const sf::String &TextLayout::getString()const{
+	return m_String;
+}
+
+int TextLayout::getCharacterSize()const{
+	return m_CharacterSize;
+}
+
+const sf::Color &TextLayout::getColor()const{
+	return m_Color;
+}
+
+const std::vector<GlyphRun> &TextLayout::getRuns()const{
+	return m_Runs;
+}
+
+const RichTextMetrics &TextLayout::getMetrics()const{
+	return m_Metrics;
+}
+
+bool TextLayout::isCurrent()const{
+	for (const auto &run : m_Runs) {
+		if(!run.Vector && run.Font->getPageId(m_CharacterSize) != run.PageId)
+			return false;
+	}
+	return true;
+}
+
+PrebuiltText::PrebuiltText(TextLayout&& layout):
+	m_Layout(std::move(layout))
+{}
+
+void PrebuiltText::setLayout(TextLayout&& layout){
+	m_Layout = std::move(layout);
+}
+
+const TextLayout &PrebuiltText::getLayout()const{
+	return m_Layout;
+}
+
+sf::FloatRect PrebuiltText::getLocalBounds()const{
+	return m_Layout.getMetrics().Bounds;
+}
+
+sf::FloatRect PrebuiltText::getGlobalBounds()const{
+	return getTransform().transformRect(getLocalBounds());
+}
+
+void PrebuiltText::draw(sf::RenderTarget& target, sf::RenderStates states)const{
+	if(!m_Layout.getRichFont())
+		return;
+
+	if (!m_Layout.isCurrent()) {
+		RICH_TEXT_TRACE_ZONE("PrebuiltText::relayout");
+		m_Layout = TextLayout::create(*m_Layout.getRichFont(), m_Layout.getString(), m_Layout.getCharacterSize(), m_Layout.getColor());
+	}
+
+	RICH_TEXT_TRACE_ZONE("PrebuiltText::draw");
+
+	states.transform *= getTransform();
+
+	for (const auto &run : m_Layout.getRuns()) {
+		if(run.Vertices.empty())
+			continue;
+
+		// Uploads the glyphs the workers rasterized, on the thread owning the context
+		states.texture = run.Vector ? nullptr : &run.Font->getTexture(m_Layout.getCharacterSize());
+		target.draw(run.Vertices.data(), run.Vertices.size(), sf::Triangles, states);
+		RICH_TEXT_COUNT(RichTextCounters::global(), DrawCalls, 1);
+	}
+}
+
+TextLayoutPool::TextLayoutPool(unsigned int threads){
+	m_Workers.reserve(threads);
+
+	for(unsigned int i = 0; i < threads; i++)
+		m_Workers.emplace_back(&TextLayoutPool::work, this);
+}
+
+TextLayoutPool::~TextLayoutPool(){
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Stop = true;
+	}
+	m_HasJobs.notify_all();
+
+	for (auto &worker : m_Workers)
+		worker.join();
+}
+
+std::size_t TextLayoutPool::getThreadCount()const{
+	return m_Workers.size();
+}
+
+std::vector<TextLayout> TextLayoutPool::layout(const RichFont& font, const std::vector<sf::String>& strings, int character_size, const sf::Color& color){
+	RICH_TEXT_TRACE_ZONE_ARG("TextLayoutPool::layout", "strings", strings.size());
+
+	std::vector<TextLayout> layouts(strings.size());
+
+	parallelFor(strings.size(), s_LayoutBatch, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++)
+			layouts[i] = TextLayout::create(font, strings[i], character_size, color);
+	});
+
+	return layouts;
+}
+
+void TextLayoutPool::parallelFor(std::size_t count, std::size_t batch, const std::function<void(std::size_t, std::size_t)>& job){
+	if(!count)
+		return;
+
+	batch = std::max<std::size_t>(batch, 1);
+
+	if (m_Workers.empty() || count <= batch) {
+		job(0, count);
+		return;
+	}
+
+	std::mutex done_lock;
+	std::condition_variable done;
+	std::size_t remaining = (count + batch - 1) / batch;
+	// First exception a batch threw, rethrown here once every batch is accounted for
+	std::exception_ptr error;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		for (std::size_t begin = 0; begin < count; begin += batch) {
+			const std::size_t end = std::min(begin + batch, count);
+
+			m_Jobs.emplace_back([&, begin, end]() {
+				std::exception_ptr thrown;
+				try {
+					job(begin, end);
+				} catch (...) {
+					thrown = std::current_exception();
+				}
+
+				std::lock_guard<std::mutex> lock(done_lock);
+				if(thrown && !error)
+					error = thrown;
+				if(--remaining == 0)
+					done.notify_all();
+			});
+		}
+	}
+	m_HasJobs.notify_all();
+
+	// Help instead of blocking, then wait for the batches other threads picked up
+	while (runOne())
+		;
+
+	std::unique_lock<std::mutex> lock(done_lock);
+	done.wait(lock, [&]() { return remaining == 0; });
+
+	if(error)
+		std::rethrow_exception(error);
+}
+
+void TextLayoutPool::work(){
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_Lock);
+			m_HasJobs.wait(lock, [this]() { return m_Stop || !m_Jobs.empty(); });
+
+			if(m_Stop && m_Jobs.empty())
+				return;
+
+			job = std::move(m_Jobs.front());
+			m_Jobs.pop_front();
+		}
+		job();
+	}
+}
+
+bool TextLayoutPool::runOne(){
+	std::function<void()> job;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		if(m_Jobs.empty())
+			return false;
+
+		job = std::move(m_Jobs.front());
+		m_Jobs.pop_front();
+	}
+	job();
+	return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "rich_text.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Glyphs of one font, ready to be drawn with the font's page of the layout's character size
+struct GlyphRun {
+	const ColorFont *Font = nullptr;
+	// Two triangles per glyph, or the triangles of the glyphs' outlines for vector sizes
+	std::vector<sf::Vertex> Vertices;
+	// Page the texture coordinates point into, see ColorFont::getPageId. Zero for vector runs
+	sf::Uint64 PageId = 0;
+	// Drawn without texture, see ColorFont::isVectorSize
+	bool Vector = false;
+};
+
+// Result of the layout stage: a line laid out into glyph runs, without any sf::Drawable state.
+// It is immutable once created and can be created on any thread, since glyph lookups only
+// rasterize into the font's pending uploads and the textures are touched on draw. Regular style only.
+class TextLayout {
+	const RichFont *m_Font = nullptr;
+	sf::String m_String;
+	int m_CharacterSize = 0;
+	sf::Color m_Color = sf::Color::White;
+	std::vector<GlyphRun> m_Runs;
+	RichTextMetrics m_Metrics;
+public:
+	TextLayout() = default;
+
+	static TextLayout create(const RichFont &font, const sf::String &string, int character_size, const sf::Color &color = sf::Color::White);
+
+	const RichFont *getRichFont()const;
+
+	const sf::String &getString()const;
+
+	int getCharacterSize()const;
+
+	const sf::Color &getColor()const;
+
+	const std::vector<GlyphRun> &getRuns()const;
+
+	// Same values RichFont::measure and RichTextLine report
+	const RichTextMetrics &getMetrics()const;
+
+	// False when a font page was released by ColorFont::trim since the layout was made, the texture coordinates are stale then
+	bool isCurrent()const;
+};
+
+// Draws a TextLayout on the render thread. Committing a layout only moves its vertices in,
+// a layout gone stale after a ColorFont::trim is redone here before drawing.
+class PrebuiltText: public sf::Drawable, public sf::Transformable{
+	mutable TextLayout m_Layout;
+public:
+	PrebuiltText() = default;
+
+	PrebuiltText(TextLayout &&layout);
+
+	void setLayout(TextLayout &&layout);
+
+	const TextLayout &getLayout()const;
+
+	sf::FloatRect getLocalBounds()const;
+
+	sf::FloatRect getGlobalBounds()const;
+
+	void draw(sf::RenderTarget& target, sf::RenderStates states)const override;
+};
+
+// Worker threads for the layout stage. The calling thread takes jobs too while it waits, so a pool
+// of N threads lays out on N + 1 cores.
+class TextLayoutPool {
+	std::vector<std::thread> m_Workers;
+	std::mutex m_Lock;
+	std::condition_variable m_HasJobs;
+	std::deque<std::function<void()>> m_Jobs;
+	bool m_Stop = false;
+public:
+	// Defaults to one worker less than the hardware threads, the caller being the last one
+	TextLayoutPool(unsigned int threads = std::max(std::thread::hardware_concurrency(), 2u) - 1);
+
+	TextLayoutPool(const TextLayoutPool &) = delete;
+
+	TextLayoutPool &operator=(const TextLayoutPool &) = delete;
+
+	~TextLayoutPool();
+
+	std::size_t getThreadCount()const;
+
+	// Lays the strings out in parallel, the result is in the order of the strings
+	std::vector<TextLayout> layout(const RichFont &font, const std::vector<sf::String> &strings, int character_size, const sf::Color &color = sf::Color::White);
+
+	// Calls job(begin, end) over [0, count) split into batches of at most 'batch' items, returns once all are done.
+	// If batches throw, the first exception is rethrown on the caller after the others finished
+	void parallelFor(std::size_t count, std::size_t batch, const std::function<void(std::size_t, std::size_t)> &job);
+private:
+	void work();
+
+	// Takes a job if there is one, true if it ran something
+	bool runOne();
+};
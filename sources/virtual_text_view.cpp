@@ -0,0 +1,385 @@
+#include "virtual_text_view.hpp"
+#include <bsl/log.hpp>
+#include <SFML/Graphics/RenderTarget.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+DEFINE_LOG_CATEGORY(VirtualTextView)
+
+MappedFile::~MappedFile(){
+	close();
+}
+
+bool MappedFile::open(const std::string& path){
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size)){
+		CloseHandle(file);
+		return false;
+	}
+
+	m_File = file;
+	m_Size = static_cast<std::size_t>(size.QuadPart);
+
+	// Empty files can't be mapped, they just have no data
+	if(!m_Size)
+		return true;
+
+	m_Mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(m_Mapping)
+		m_Data = static_cast<const char*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if(file < 0)
+		return false;
+
+	struct stat info;
+	if(fstat(file, &info) != 0){
+		::close(file);
+		return false;
+	}
+
+	m_Size = static_cast<std::size_t>(info.st_size);
+
+	// Empty files can't be mapped, they just have no data
+	if(!m_Size){
+		::close(file);
+		return true;
+	}
+
+	void *data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+
+	if(data != MAP_FAILED){
+		// Lines are mostly read front to back while scrolling
+		madvise(data, m_Size, MADV_SEQUENTIAL);
+		m_Data = static_cast<const char*>(data);
+	}
+#endif
+
+	if(!m_Data){
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close(){
+#ifdef _WIN32
+	if(m_Data)
+		UnmapViewOfFile(m_Data);
+	if(m_Mapping)
+		CloseHandle(m_Mapping);
+	if(m_File)
+		CloseHandle(m_File);
+
+	m_Mapping = nullptr;
+	m_File = nullptr;
+#else
+	if(m_Data)
+		munmap(const_cast<char*>(m_Data), m_Size);
+#endif
+
+	m_Data = nullptr;
+	m_Size = 0;
+}
+
+const char *MappedFile::data()const{
+	return m_Data;
+}
+
+std::size_t MappedFile::size()const{
+	return m_Size;
+}
+
+bool VirtualTextView::open(const std::string& path){
+	m_Checkpoints.clear();
+	m_IndexedLines = 0;
+	m_ScanPosition = 0;
+	m_FullyIndexed = true;
+
+	invalidate();
+
+	if(!m_File.open(path)){
+		LogVirtualTextView(Error, "Can't map file '%'", path);
+		return false;
+	}
+
+	// Nothing is scanned yet: opening costs the same whatever the file size
+	if(m_File.size()){
+		m_Checkpoints.push_back(0);
+		m_IndexedLines = 1;
+		m_FullyIndexed = false;
+	}
+
+	update();
+
+	return true;
+}
+
+void VirtualTextView::setRichFont(const RichFont& font){
+	m_Font = &font;
+
+	invalidate();
+	update();
+}
+
+void VirtualTextView::setCharacterSize(int size){
+	m_CharacterSize = size;
+
+	invalidate();
+	update();
+}
+
+void VirtualTextView::setFillColor(const sf::Color& color){
+	m_FillColor = color;
+
+	for(auto &slot: m_Slots)
+		slot.Text.setFillColor(color);
+}
+
+void VirtualTextView::setPrefetchLines(std::size_t lines){
+	m_PrefetchLines = lines;
+
+	update();
+}
+
+void VirtualTextView::setViewport(const sf::FloatRect& viewport){
+	m_Left = viewport.left;
+	m_ViewportSize = sf::Vector2f(viewport.width, viewport.height);
+	m_TopLine = 0;
+	m_TopOffset = viewport.top;
+
+	update();
+}
+
+void VirtualTextView::setViewportSize(const sf::Vector2f& size){
+	m_ViewportSize = size;
+
+	update();
+}
+
+void VirtualTextView::scrollTo(std::size_t line, float offset){
+	m_TopLine = line;
+	m_TopOffset = offset;
+
+	update();
+}
+
+void VirtualTextView::scrollBy(float pixels){
+	m_TopOffset += pixels;
+
+	update();
+}
+
+std::size_t VirtualTextView::getTopLine()const{
+	return m_TopLine;
+}
+
+float VirtualTextView::getTopOffset()const{
+	return m_TopOffset;
+}
+
+float VirtualTextView::getLineSpacing()const{
+	return m_LineSpacing;
+}
+
+bool VirtualTextView::indexStep(std::size_t max_bytes){
+	if(m_FullyIndexed)
+		return true;
+
+	scan(max_bytes);
+
+	// The scan above was this frame's budget
+	if(m_WaitingForIndex)
+		update(0);
+
+	return m_FullyIndexed;
+}
+
+void VirtualTextView::scan(std::size_t max_bytes){
+	const char *data = m_File.data();
+	const std::size_t size = m_File.size();
+	const std::size_t limit = std::min(size, m_ScanPosition + max_bytes);
+
+	while (m_ScanPosition < limit) {
+		const char *newline = static_cast<const char*>(std::memchr(data + m_ScanPosition, '\n', limit - m_ScanPosition));
+
+		if(!newline){
+			m_ScanPosition = limit;
+			break;
+		}
+
+		m_ScanPosition = newline - data + 1;
+
+		// A trailing newline ends the last line instead of opening an empty one
+		if(m_ScanPosition < size){
+			if(m_IndexedLines % LineCheckpoint == 0)
+				m_Checkpoints.push_back(m_ScanPosition);
+
+			m_IndexedLines++;
+		}
+	}
+
+	m_FullyIndexed = m_ScanPosition >= size;
+}
+
+bool VirtualTextView::isFullyIndexed()const{
+	return m_FullyIndexed;
+}
+
+std::size_t VirtualTextView::getIndexedLineCount()const{
+	return m_IndexedLines;
+}
+
+bool VirtualTextView::indexUpTo(std::size_t line, std::size_t max_bytes){
+	const std::size_t limit = m_ScanPosition + max_bytes;
+
+	while (m_IndexedLines <= line && !m_FullyIndexed && m_ScanPosition < limit)
+		scan(std::min<std::size_t>(1 << 20, limit - m_ScanPosition));
+
+	return line < m_IndexedLines;
+}
+
+bool VirtualTextView::findLine(std::size_t line, const char *&begin, const char *&end){
+	if(line >= m_IndexedLines)
+		return false;
+
+	const char *data_end = m_File.data() + m_File.size();
+
+	begin = m_File.data() + m_Checkpoints[line / LineCheckpoint];
+	for (std::size_t i = 0; i < line % LineCheckpoint; i++)
+		begin = static_cast<const char*>(std::memchr(begin, '\n', data_end - begin)) + 1;
+
+	end = static_cast<const char*>(std::memchr(begin, '\n', data_end - begin));
+	if(!end)
+		end = data_end;
+
+	if(end != begin && *(end - 1) == '\r')
+		--end;
+
+	// Cut overlong lines, without splitting an UTF-8 sequence
+	if(static_cast<std::size_t>(end - begin) > MaxLineBytes){
+		end = begin + MaxLineBytes;
+		while (end != begin && (static_cast<unsigned char>(*end) & 0xC0) == 0x80)
+			--end;
+	}
+
+	return true;
+}
+
+void VirtualTextView::invalidate(){
+	m_Slots.clear();
+	m_FirstLine = m_LastLine = 0;
+
+	m_LineSpacing = m_CharacterSize && m_Font && m_Font->valid() ? m_Font->findFontForGlyph(L' ')->getLineSpacing(m_CharacterSize) : 0.f;
+}
+
+void VirtualTextView::normalizeScroll(){
+	if(!m_LineSpacing)
+		return;
+
+	double lines = std::floor(m_TopOffset / m_LineSpacing);
+
+	// Above the first line the offset stays negative
+	if(lines < 0)
+		lines = -std::min(-lines, static_cast<double>(m_TopLine));
+
+	m_TopLine = static_cast<std::size_t>(static_cast<double>(m_TopLine) + lines);
+	m_TopOffset = static_cast<float>(m_TopOffset - lines * m_LineSpacing);
+}
+
+void VirtualTextView::update(std::size_t index_budget){
+	m_WaitingForIndex = false;
+
+	if(!m_LineSpacing || !m_File.size())
+		return;
+
+	normalizeScroll();
+
+	double first = std::floor(m_TopOffset / m_LineSpacing) - static_cast<double>(m_PrefetchLines);
+	double last = std::ceil((static_cast<double>(m_TopOffset) + m_ViewportSize.y) / m_LineSpacing) + static_cast<double>(m_PrefetchLines);
+
+	// Relative to the top line, which can be far past what a double holds to the pixel
+	m_FirstLine = first < 0 ? m_TopLine - std::min(m_TopLine, static_cast<std::size_t>(-first)) : m_TopLine + static_cast<std::size_t>(first);
+	m_LastLine = last < 0 ? m_TopLine - std::min(m_TopLine, static_cast<std::size_t>(-last)) : m_TopLine + static_cast<std::size_t>(last);
+
+	if(m_LastLine > m_FirstLine)
+		indexUpTo(m_LastLine - 1, index_budget);
+
+	// Lines that scrolled out of the window give their geometry to the ones scrolling in
+	for (auto &slot : m_Slots) {
+		if(slot.Line < m_FirstLine || slot.Line >= m_LastLine)
+			slot.Used = false;
+	}
+
+	for (std::size_t line = m_FirstLine; line < m_LastLine; line++) {
+		auto loaded = std::find_if(m_Slots.begin(), m_Slots.end(), [line](const Slot &slot){
+			return slot.Used && slot.Line == line;
+		});
+
+		if(loaded != m_Slots.end())
+			continue;
+
+		const char *begin = nullptr, *end = nullptr;
+		if(!findLine(line, begin, end)){
+			m_WaitingForIndex = !m_FullyIndexed;
+			m_LastLine = line;
+			break;
+		}
+
+		auto slot = std::find_if(m_Slots.begin(), m_Slots.end(), [](const Slot &slot){
+			return !slot.Used;
+		});
+
+		if(slot == m_Slots.end()){
+			m_Slots.emplace_back();
+			slot = m_Slots.end() - 1;
+			slot->Text.setRichFont(*m_Font);
+			slot->Text.setCharacterSize(m_CharacterSize);
+		}
+
+		slot->Line = line;
+		slot->Used = true;
+		slot->Text.setString(sf::String::fromUtf8(begin, end));
+		slot->Text.setFillColor(m_FillColor);
+	}
+}
+
+void VirtualTextView::draw(sf::RenderTarget& target, sf::RenderStates states) const{
+	states.transform *= getTransform();
+
+	for (const auto &slot : m_Slots) {
+		if(!slot.Used)
+			continue;
+
+		// Relative to the top line, absolute positions in huge files don't fit a float
+		double lines = slot.Line >= m_TopLine ? static_cast<double>(slot.Line - m_TopLine) : -static_cast<double>(m_TopLine - slot.Line);
+		double y = lines * m_LineSpacing - m_TopOffset;
+
+		sf::RenderStates line_states = states;
+		line_states.transform.translate(-m_Left, static_cast<float>(y));
+
+		target.draw(slot.Text, line_states);
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "rich_text.hpp"
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+	const char *m_Data = nullptr;
+	std::size_t m_Size = 0;
+#ifdef _WIN32
+	void *m_File = nullptr;
+	void *m_Mapping = nullptr;
+#endif
+public:
+	MappedFile() = default;
+
+	MappedFile(const MappedFile &) = delete;
+
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	~MappedFile();
+
+	bool open(const std::string &path);
+
+	void close();
+
+	const char *data()const;
+
+	std::size_t size()const;
+};
+
+// Scrollable view over a (potentially huge) UTF-8 file. Line starts are indexed lazily, only as far
+// as the view has scrolled, and only lines intersecting the viewport plus a prefetch margin are laid
+// out. Their RichTextLine objects are recycled as the view moves, so the cost of opening and
+// scrolling does not depend on the file size. A jump far past the indexed lines only indexes a
+// bounded amount of the file, indexStep called every frame brings the view there.
+class VirtualTextView: public sf::Drawable, public sf::Transformable{
+	// One line start out of LineCheckpoint is remembered, the others are found again by scanning
+	static constexpr std::size_t LineCheckpoint = 64;
+	// Lines are cut after that many bytes, to bound the layout cost of a pathological line
+	static constexpr std::size_t MaxLineBytes = 4096;
+	// Bytes a viewport change may index on its own, the rest is left to indexStep
+	static constexpr std::size_t IndexBudget = 4 << 20;
+
+	struct Slot {
+		std::size_t Line = 0;
+		bool Used = false;
+		RichTextLine Text;
+	};
+
+	MappedFile m_File;
+	std::vector<std::size_t> m_Checkpoints;
+	std::size_t m_IndexedLines = 0;
+	std::size_t m_ScanPosition = 0;
+	bool m_FullyIndexed = false;
+	// Lines of the viewport are past the index, indexStep updates the view as it reaches them
+	bool m_WaitingForIndex = false;
+
+	std::vector<Slot> m_Slots;
+	std::size_t m_FirstLine = 0;
+	std::size_t m_LastLine = 0;
+	std::size_t m_PrefetchLines = 8;
+	// Scroll position as the line at the top of the viewport and the pixels of it scrolled past,
+	// a float or even double pixel offset gets too coarse in files of hundreds of millions of lines
+	std::size_t m_TopLine = 0;
+	float m_TopOffset = 0.f;
+	float m_Left = 0.f;
+	sf::Vector2f m_ViewportSize;
+
+	const RichFont *m_Font = nullptr;
+	int m_CharacterSize = 0;
+	float m_LineSpacing = 0.f;
+	sf::Color m_FillColor = sf::Color::White;
+public:
+	bool open(const std::string &path);
+
+	void setRichFont(const RichFont &font);
+
+	void setCharacterSize(int size);
+
+	void setFillColor(const sf::Color &color);
+
+	// Number of lines laid out above and below the viewport, ready to be scrolled in
+	void setPrefetchLines(std::size_t lines);
+
+	// Area of the document to display, it is drawn with its top left corner at the local origin.
+	// A float top is only exact to the pixel up to 16M pixels, scroll deeper with scrollTo or scrollBy
+	void setViewport(const sf::FloatRect &viewport);
+
+	void setViewportSize(const sf::Vector2f &size);
+
+	// Puts 'line' at the top of the viewport, scrolled 'offset' pixels past its top
+	void scrollTo(std::size_t line, float offset = 0.f);
+
+	// Scrolls down, or up for negative pixels, from the current position without losing precision
+	void scrollBy(float pixels);
+
+	std::size_t getTopLine()const;
+
+	float getTopOffset()const;
+
+	float getLineSpacing()const;
+
+	// Indexes the next 'max_bytes' of the file, returns true once the whole file is indexed.
+	// Lets the full line count be computed in the background, a frame at a time
+	bool indexStep(std::size_t max_bytes);
+
+	bool isFullyIndexed()const;
+
+	// Number of lines known so far, the total one once the file is fully indexed
+	std::size_t getIndexedLineCount()const;
+private:
+	void scan(std::size_t max_bytes);
+
+	// Indexes until the start of 'line' is known or 'max_bytes' were scanned, returns false if it isn't known
+	bool indexUpTo(std::size_t line, std::size_t max_bytes);
+
+	// Moves whole lines of the top offset into the top line
+	void normalizeScroll();
+
+	bool findLine(std::size_t line, const char *&begin, const char *&end);
+
+	void invalidate();
+
+	// Indexes at most 'index_budget' bytes to reach the lines of the viewport
+	void update(std::size_t index_budget = IndexBudget);
+
+	void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
+};